@@ -32,30 +32,507 @@
 #include "regex.h"
 #include<cassert>
 #include<cmath>
+#include<algorithm>
+#include<deque>
+#include<cstring>
 
 namespace infiniband {
 
+const size_t port_masks_t::mask_word_bits = 64;
+
+port_masks_t::port_masks_t()
+  : mask_words(1)
+{
+}
+
+void port_masks_t::set_radix(const port_num_t radix)
+{
+  const size_t words = static_cast<size_t>(radix) / mask_word_bits + 1;
+  if(words <= mask_words)
+    return;
+  
+  ///Widen every existing mask in place
+  const size_t count = size();
+  std::vector<mask_word_t> widened(count * words, 0);
+  for(size_t i = 0; i < count; ++i)
+    std::copy(
+      masks.begin() + i * mask_words, 
+      masks.begin() + (i + 1) * mask_words, 
+      widened.begin() + i * words
+    );
+  
+  masks.swap(widened);
+  mask_words = words;
+}
+
+bool port_masks_t::add_port(const size_t mask, const port_num_t port)
+{
+  set_radix(port);
+  
+  if(mask >= size())
+    masks.resize((mask + 1) * mask_words, 0);
+  
+  mask_word_t &word = masks[mask * mask_words + port / mask_word_bits];
+  const mask_word_t bit = static_cast<mask_word_t>(1) << (port % mask_word_bits);
+  const bool added = !(word & bit);
+  word |= bit;
+  
+  return added;
+}
+
+bool port_masks_t::has_port(const size_t mask, const port_num_t port) const
+{
+  if(mask >= size() || port / mask_word_bits >= mask_words)
+    return false;
+  
+  return masks[mask * mask_words + port / mask_word_bits] & (static_cast<mask_word_t>(1) << (port % mask_word_bits));
+}
+
+const port_masks_t::mask_word_t * port_masks_t::get(const size_t mask) const
+{
+  if(mask >= size())
+    return NULL;
+  
+  return &masks[mask * mask_words];
+}
+
+bool port_masks_t::get_ports(const size_t mask, ports_t &ports) const
+{
+  const mask_word_t * const words = get(mask);
+  if(!words)
+    return false;
+  
+  for(size_t w = 0; w < mask_words; ++w)
+    for(size_t bit = 0; bit < mask_word_bits && (words[w] >> bit); ++bit)
+      if(words[w] & (static_cast<mask_word_t>(1) << bit))
+        ports.push_back(static_cast<port_num_t>(w * mask_word_bits + bit));
+  
+  return true;
+}
+
+const size_t multicast_forwarding_table_t::mask_word_bits = port_masks_t::mask_word_bits;
+
+multicast_forwarding_table_t::multicast_forwarding_table_t()
+{
+}
+
+void multicast_forwarding_table_t::set_radix(const port_num_t radix)
+{
+  masks.set_radix(radix);
+}
+
+bool multicast_forwarding_table_t::add_port(const lid_t mlid, const port_num_t port)
+{
+  assert(mlid > 0);
+  
+  std::pair<mlid_index_t::iterator, bool> result = mlids.insert(std::make_pair(mlid, mlids.size()));
+  return masks.add_port(result.first->second, port);
+}
+
+bool multicast_forwarding_table_t::has_port(const lid_t mlid, const port_num_t port) const
+{
+  mlid_index_t::const_iterator itr = mlids.find(mlid);
+  if(itr == mlids.end())
+    return false;
+  
+  return masks.has_port(itr->second, port);
+}
+
+const multicast_forwarding_table_t::mask_word_t * multicast_forwarding_table_t::find(const lid_t mlid) const
+{
+  mlid_index_t::const_iterator itr = mlids.find(mlid);
+  if(itr == mlids.end())
+    return NULL;
+  
+  return masks.get(itr->second);
+}
+
+void multicast_forwarding_table_t::clear()
+{
+  mlids.clear();
+  masks.clear();
+}
+
+void multicast_tree_t::clear()
+{
+  links.clear();
+  switches.clear();
+  members.clear();
+  loop = false;
+}
+
+/**
+ * @brief compare range to LID by last LID of range
+ */
+static bool lid_range_before(const lid_set_t::range_t &range, const lid_t lid)
+{
+  return range.second < lid;
+}
+
+std::pair<lid_set_t::const_iterator, bool> lid_set_t::insert(const lid_t lid)
+{
+  assert(lid > 0);
+  
+  ///first range that ends at or after lid
+  ranges_t::iterator itr = std::lower_bound(ranges.begin(), ranges.end(), lid, lid_range_before);
+  
+  if(itr != ranges.end() && itr->first <= lid)
+    return std::make_pair(const_iterator(&*itr, &*ranges.begin() + ranges.size(), lid), false);
+  
+  ++lid_count;
+  
+  const bool extend_prev = itr != ranges.begin() && (itr - 1)->second + 1 == lid;
+  const bool extend_next = itr != ranges.end() && itr->first == lid + 1;
+  
+  if(extend_prev && extend_next)
+  {
+    ///lid joins both ranges
+    (itr - 1)->second = itr->second;
+    itr = ranges.erase(itr) - 1;
+  }
+  else if(extend_prev)
+    (--itr)->second = lid;
+  else if(extend_next)
+    itr->first = lid;
+  else
+    itr = ranges.insert(itr, range_t(lid, lid));
+  
+  return std::make_pair(const_iterator(&*itr, &*ranges.begin() + ranges.size(), lid), true);
+}
+
+size_t lid_set_t::count(const lid_t lid) const
+{
+  ranges_t::const_iterator itr = std::lower_bound(ranges.begin(), ranges.end(), lid, lid_range_before);
+  return itr != ranges.end() && itr->first <= lid ? 1 : 0;
+}
+
+lid_set_t::const_iterator lid_set_t::begin() const
+{
+  if(ranges.empty())
+    return const_iterator();
+  
+  return const_iterator(&ranges.front(), &ranges.front() + ranges.size(), ranges.front().first);
+}
+
+lid_set_t::const_iterator lid_set_t::end() const
+{
+  if(ranges.empty())
+    return const_iterator();
+  
+  return const_iterator(&ranges.front() + ranges.size(), &ranges.front() + ranges.size(), 0);
+}
+
+const unsigned int port_array_t::max_ports;
+
+std::pair<port_array_t::const_iterator, bool> port_array_t::insert(const value_type &value)
+{
+  assert(value.second);
+  
+  if(test(value.first))
+    return std::make_pair(const_iterator(this, value.first), false);
+  
+  if(value.first >= slots.size())
+    slots.resize(static_cast<size_t>(value.first) + 1, NULL);
+  
+  slots[value.first] = value.second;
+  used[value.first >> 6] |= static_cast<uint64_t>(1) << (value.first & 63);
+  ++port_count;
+  
+  return std::make_pair(const_iterator(this, value.first), true);
+}
+
+void port_array_t::clear()
+{
+  slots.clear();
+  std::fill(used, used + max_ports / 64, 0);
+  port_count = 0;
+}
+
+unsigned int port_array_t::next(unsigned int port) const
+{
+  while(port < max_ports)
+  {
+    const uint64_t word = used[port >> 6] >> (port & 63);
+    
+    ///skip to next word
+    if(!word)
+    {
+      port = (port | 63) + 1;
+      continue;
+    }
+    
+    unsigned int offset = 0;
+    while(!((word >> offset) & 1))
+      ++offset;
+    
+    return port + offset;
+  }
+  
+  return max_ports;
+}
+
+const port_num_t linear_forwarding_table_t::unreachable = 0xFF;
+const next_hop_table_t::hop_t next_hop_table_t::unreachable = 0xFFFFFFFF;
+const uint32_t next_hop_table_t::max_entity = 0xFFFFFE;
+
+bool next_hop_table_t::set(const lid_t lid, const hop_t hop)
+{
+  if(lid > MAX_LID_VALUE)
+    return false;
+  
+  return hops.set(lid, hop);
+}
+
+bool linear_forwarding_table_t::set(const lid_t lid, const port_num_t port)
+{
+  assert(port != unreachable);
+  
+  if(lid > MAX_LID_VALUE)
+    return false;
+  
+  ///Avoid copying a shared page when the route does not change
+  if(ports.find(lid) == port)
+    return true;
+  
+  return ports.set(lid, port);
+}
+
+void linear_forwarding_table_t::shrink()
+{
+  ports.shrink();
+}
+
+bool linear_forwarding_table_t::operator==(const linear_forwarding_table_t &other) const
+{
+  return ports == other.ports;
+}
+
+adaptive_routing_table_t::adaptive_routing_table_t()
+{
+}
+
+void adaptive_routing_table_t::set_radix(const port_num_t radix)
+{
+  masks.set_radix(radix);
+}
+
+bool adaptive_routing_table_t::add_group_port(const group_t group, const port_num_t port)
+{
+  return masks.add_port(group, port);
+}
+
+void adaptive_routing_table_t::set_lid_group(const lid_t lid, const group_t group, const plft_num_t plft)
+{
+  assert(lid > 0);
+  
+  if(plft >= lids.size())
+    lids.resize(static_cast<size_t>(plft) + 1);
+  
+  lids[plft][lid] = group;
+}
+
+bool adaptive_routing_table_t::find_group(const lid_t lid, group_t &group, const plft_num_t plft) const
+{
+  if(plft >= lids.size())
+    return false;
+  
+  lid_groups_t::const_iterator itr = lids[plft].find(lid);
+  if(itr == lids[plft].end())
+    return false;
+  
+  group = itr->second;
+  return true;
+}
+
+const adaptive_routing_table_t::mask_word_t * adaptive_routing_table_t::find_mask(const group_t group) const
+{
+  return masks.get(group);
+}
+
+bool adaptive_routing_table_t::get_group_ports(const group_t group, ports_t &ports) const
+{
+  return masks.get_ports(group, ports);
+}
+
+const adaptive_routing_table_t::lid_groups_t & adaptive_routing_table_t::get_lids(const plft_num_t plft) const
+{
+  static const lid_groups_t none;
+  
+  if(plft >= lids.size())
+    return none;
+  
+  return lids[plft];
+}
+
+bool adaptive_routing_table_t::empty() const
+{
+  for(size_t plft = 0; plft < lids.size(); ++plft)
+    if(!lids[plft].empty())
+      return false;
+  
+  return true;
+}
+
+void adaptive_routing_table_t::clear()
+{
+  lids.clear();
+  masks.clear();
+}
+
+void adaptive_route_t::clear()
+{
+  hops.clear();
+  reached = false;
+  loop = false;
+}
+
+sl2vl_tables_t::sl2vl_tables_t()
+  : has_common(false), common(0)
+{
+}
+
+void sl2vl_tables_t::set(const port_num_t in, const port_num_t out, const sl2vl_t table)
+{
+  staged.push_back(tables_t::value_type(static_cast<key_t>(in) << 8 | out, table));
+}
+
+/**
+ * @brief compare port pair table keys only
+ */
+static bool sl2vl_key_less(
+  const std::pair<uint16_t, sl2vl_tables_t::sl2vl_t> &a, 
+  const std::pair<uint16_t, sl2vl_tables_t::sl2vl_t> &b
+)
+{
+  return a.first < b.first;
+}
+
+void sl2vl_tables_t::compact()
+{
+  if(staged.empty())
+    return;
+  
+  /**
+   * Merge staged tables over the current tables 
+   * latest table given for a port pair wins
+   */
+  tables_t merged(tables);
+  merged.insert(merged.end(), staged.begin(), staged.end());
+  staged.clear();
+  std::stable_sort(merged.begin(), merged.end(), sl2vl_key_less);
+  
+  tables_t unique;
+  unique.reserve(merged.size());
+  for(size_t i = 0; i < merged.size(); ++i)
+    if(i + 1 == merged.size() || merged[i].first != merged[i + 1].first)
+      unique.push_back(merged[i]);
+  
+  if(!has_common)
+  {
+    ///Most common table becomes entity wide table
+    std::map<sl2vl_t, size_t> counts;
+    size_t max_count = 0;
+    for(tables_t::const_iterator itr = unique.begin(); itr != unique.end(); ++itr)
+    {
+      const size_t count = ++counts[itr->second];
+      if(count > max_count)
+      {
+        max_count = count;
+        common = itr->second;
+      }
+    }
+    
+    has_common = true;
+  }
+  
+  tables.clear();
+  for(tables_t::const_iterator itr = unique.begin(); itr != unique.end(); ++itr)
+    if(itr->second != common)
+      tables.push_back(*itr);
+  
+  ///release unused capacity
+  tables_t(tables).swap(tables);
+  tables_t().swap(staged);
+}
+
+bool sl2vl_tables_t::find(const port_num_t in, const port_num_t out, sl2vl_t &table) const
+{
+  assert(staged.empty());
+  
+  if(!has_common)
+    return false;
+  
+  const tables_t::value_type key(static_cast<key_t>(in) << 8 | out, 0);
+  tables_t::const_iterator itr = std::lower_bound(tables.begin(), tables.end(), key, sl2vl_key_less);
+  
+  if(itr != tables.end() && itr->first == key.first)
+    table = itr->second;
+  else
+    table = common;
+  
+  return true;
+}
+
+bool sl2vl_tables_t::find_vl(const port_num_t in, const port_num_t out, const sl_t sl, vl_t &vl) const
+{
+  sl2vl_t table = 0;
+  
+  if(sl >= SL_COUNT || !find(in, out, table))
+    return false;
+  
+  vl = get_vl(table, sl);
+  return true;
+}
+
+void sl2vl_tables_t::clear()
+{
+  has_common = false;
+  common = 0;
+  tables_t().swap(tables);
+  tables_t().swap(staged);
+}
+
 entity_t::entity_t(const guid_t _guid, const entity_t::type_t _type)
-  : guid(_guid), type(_type)
+  : guid(_guid), routes_stale(false), type(_type)
 {
   assert(guid > 0);
   assert(type != port_type::UNKNOWN);
 }
 
 entity_t::entity_t(const entity_t& other)
-  : guid(other.guid), type(other.type)
+  : guid(other.guid), ports(other.ports), mft(other.mft), art(other.art), sl2vl(other.sl2vl),
+    routes(other.routes), routes_stale(other.routes_stale), ufts(other.ufts), next_hops(other.next_hops), 
+    port_plfts(other.port_plfts), page_store(other.page_store), type(other.type), entity_label(other.entity_label)
 {
   assert(guid > 0);
   assert(type != port_type::UNKNOWN);
 }
 
+entity_t::entity_t(entity_t&& other) noexcept
+  : guid(other.guid), ports(std::move(other.ports)), mft(std::move(other.mft)), art(std::move(other.art)), 
+    sl2vl(std::move(other.sl2vl)), routes(std::move(other.routes)), routes_stale(other.routes_stale), ufts(std::move(other.ufts)), 
+    next_hops(std::move(other.next_hops)), port_plfts(std::move(other.port_plfts)), page_store(std::move(other.page_store)), type(other.type), 
+    entity_label(std::move(other.entity_label))
+{
+}
+
 bool entity_t::add_port(port_t*const port)
 {
-  assert(ports.find(port->port) == ports.end());
+  assert(!ports.get(port->port));
   
   std::pair<portmap_t::iterator, bool> result = ports.insert(std::make_pair(port->port, port));
   assert(result.second);
   
+  ///egress port resolves to another neighbour now
+  next_hops.clear();
+  
+  ///label comes from the first port
+  if(result.second && result.first == ports.begin())
+  {
+    entity_label.clear();
+    port->append_label(entity_label, port_t::LABEL_ENTITY_ONLY);
+  }
+  
 #ifndef NDEBUG
   /**
    * Sanity check that all ports
@@ -100,16 +577,16 @@ bool fabric_t::add_cable(port_t*const port1, port_t*const port2)
     
     ///make sure both ports already known or not known
     assert(
-      (portmap.find(port2) != portmap.end())
+      (porthash.find(port2->guid, port2->port) != NULL)
       ==
-      (portmap.find(port1) != portmap.end())
+      (porthash.find(port1->guid, port1->port) != NULL)
     );
   }
   
   /**
     * detect if port already known and skip if need be
     */
-  if(portmap.find(port1) != portmap.end())
+  if(porthash.find(port1->guid, port1->port))
   {
     /**
      * Port already known
@@ -118,32 +595,44 @@ bool fabric_t::add_cable(port_t*const port1, port_t*const port2)
      */
     assert(false);
     
-    delete port1;
-    delete port2;
+    release_port(port1);
+    if(port2)
+      release_port(port2);
   }
   else
   {
     /**
      * Port unknown
+     * fabric owns ports from now on
      */
-    entity_t &port1_entity = find_entity(port1->guid, port1->type, true)->second;
+    if(!arena.created(port1))
+      arena.adopt(port1);
+    if(port2 && !arena.created(port2))
+      arena.adopt(port2);
+    
+    ///cables of indexed ports may have changed
+    portrecords_stale = true;
+    
+    entity_t &port1_entity = *find_entity(port1->guid, port1->type, true);
     if(!port1_entity.add_port(port1))
       return false;
     
     { //Add port to portmap 
       std::pair<portmap_guidport_t::iterator, bool> result = portmap.insert(std::make_pair(port1, port1));
       assert(result.second);
+      porthash.insert(port1->guid, port1->port, port1);
     }
     
     if(port2)
     {
-      entity_t &port2_entity = find_entity(port2->guid, port2->type, true)->second;
+      entity_t &port2_entity = *find_entity(port2->guid, port2->type, true);
       if(!port2_entity.add_port(port2))
         return false;
       
       { //Add port to portmap 
         std::pair<portmap_guidport_t::iterator, bool> result = portmap.insert(std::make_pair(port2, port2));
         assert(result.second);
+        porthash.insert(port2->guid, port2->port, port2);
       }
     }
   }
@@ -151,37 +640,106 @@ bool fabric_t::add_cable(port_t*const port1, port_t*const port2)
   return true;
 }
 
-std::map< guid_t, entity_t >::iterator fabric_t::find_entity(guid_t guid, entity_t::type_t type, bool create)
+fabric_t::entities_t::iterator fabric_t::find_entity(guid_t guid, entity_t::type_t type, bool create)
 {
-  entities_t::iterator entity_itr = entities.find(guid);
+  const uint32_t id = get_entity_id(guid);
+  
+  if(id != no_entity)
+  {
+    assert(!create || entities[id].get_type() == type);
+    return entities.begin() + id;
+  }
   
   if(!create)
-    return entity_itr;
+    return entities.end();
     
   /*
    * guid not known to fabric
+   * Create New entity with the next id
    */
-  if(entity_itr == entities.end())
+  const entity_t * const first = entities.empty() ? NULL : &entities.front();
+  entities.push_back(entity_t(guid, type));
+  if(page_store)
+    entities.back().set_page_store(page_store);
+  
+  ///every entity moved if entities grew
+  if(first && first != &entities.front())
+    index_entities();
+  else
+    entityhash.insert(guid, 0, &entities.back());
+  
+  assert(entities.back().guid == guid);
+  assert(entities.back().get_type() == type);
+  
+  return entities.end() - 1;
+}
+
+void fabric_t::index_entities()
+{
+  entityhash.clear();
+  entityhash.reserve(entities.size());
+  
+  for(size_t i = 0; i < entities.size(); ++i)
+    entityhash.insert(entities[i].guid, 0, &entities[i]);
+}
+
+bool fabric_t::renumber_entities(const std::vector<uint32_t> &order)
+{
+  if(order.size() != entities.size())
   {
-    /**
-      * Create New entity and use that iterator
-      */
-    std::pair<entities_t::iterator, bool> result = entities.insert(std::make_pair(guid, entity_t(guid, type)));
+    std::cerr << "entity order has " << order.size() << " entities instead of " << entities.size() << std::endl;
+    return false;
+  }
+  
+  ///new id of every old id
+  std::vector<uint32_t> ids(entities.size(), no_entity);
+  for(size_t i = 0; i < order.size(); ++i)
+  {
+    if(order[i] >= entities.size() || ids[order[i]] != no_entity)
+    {
+      std::cerr << "entity order is not a permutation at " << i << std::endl;
+      return false;
+    }
     
-    ///This should never fail since we already check if it exists
-    assert(result.second);
-    assert(result.first->second.guid == guid);
+    ids[order[i]] = static_cast<uint32_t>(i);
+  }
+  
+  ///next hops hold packed entity ids
+  bool next_hops_built = false;
+  for(size_t i = 0; i < entities.size() && !next_hops_built; ++i)
+    next_hops_built = !entities[i].get_next_hops().empty();
+  
+  entities_t renumbered;
+  renumbered.reserve(entities.size());
+  for(size_t i = 0; i < order.size(); ++i)
+    renumbered.push_back(std::move(entities[order[i]]));
+  
+  entities.swap(renumbered);
+  index_entities();
+  
+  ///only the allocated lid map pages hold owners
+  for(size_t dir = lidmap.next_page(0); dir < lidmap.get_directory_size(); dir = lidmap.next_page(dir + 1))
+  {
+    const lidindex_t::page_t * const page = lidmap.get_page(dir);
     
-    entity_itr = result.first;
+    const lid_t base = static_cast<lid_t>(dir) << lidindex_t::page_bits;
+    for(size_t i = 0; i < lidindex_t::page_size; ++i)
+      if(page->values[i].entity != no_entity)
+      {
+        const lid_owner_t owner = { ids[page->values[i].entity], page->values[i].port };
+        lidmap.set(base + i, owner);
+      }
   }
   
-  assert(entity_itr != entities.end());
-  assert(entity_itr->second.get_type() == type);
+  for(size_t i = 0; i < portrecords.size(); ++i)
+    portrecords[i].entity = ids[portrecords[i].entity];
   
-  return entity_itr;
+  if(next_hops_built)
+    return build_next_hops();
+  
+  return true;
 }
 
-
 bool fabric_t::add_cables(fabric_t::portmap_guidport_t& _portmap)
 {
   typedef portmap_guidport_t portmap_t;
@@ -224,7 +782,7 @@ bool fabric_t::add_cables(fabric_t::portmap_guidport_t& _portmap)
       ++itr
     )
       if(itr->second)
-        delete itr->second;
+        release_port(itr->second);
   }
   
   _portmap.clear();
@@ -245,10 +803,10 @@ std::string entity_t::label(const entity_t::label_t type) const
   switch(type)
   {
     case LABEL_ENTITY_ONLY:
-      return port->label(port_t::LABEL_ENTITY_ONLY);
+      return entity_label;
       break;
     case LABEL_NAME_ONLY:
-      return port->name;
+      return port->get_name();
       break;
     case LABEL_LEAF_ONLY:
       return regex::string_cast_uint(port->leaf);
@@ -309,57 +867,905 @@ port_t const* entity_t::get_first_port() const
     return itr->second;
 }
 
-void fabric_t::print_fabric(std::ostream& ost) const
+/**
+ * @brief order entities by guid
+ */
+static bool entity_guid_less(const entity_t * const a, const entity_t * const b)
 {
-  for(
-    entities_t::const_iterator itr = entities.begin(), eitr = entities.end();
+  return a->guid < b->guid;
+}
+
+void fabric_t::print_fabric(std::ostream& ost) const
+{
+  ///reused for every port label
+  std::string label;
+  
+  ///print in guid order (ids are in creation order)
+  std::vector<const entity_t *> sorted;
+  sorted.reserve(entities.size());
+  for(size_t i = 0; i < entities.size(); ++i)
+    sorted.push_back(&entities[i]);
+  std::sort(sorted.begin(), sorted.end(), entity_guid_less);
+  
+  for(
+    std::vector<const entity_t *>::const_iterator itr = sorted.begin(), eitr = sorted.end();
     itr != eitr;
     ++itr)
   {
-    ost << "Entity: " << itr->second.label() << std::endl;
+    const entity_t &entity = **itr;
+    ost << "Entity: " << entity.get_label() << std::endl;
     
     for(
-      entity_t::portmap_t::const_iterator pitr = itr->second.ports.begin(), peitr = itr->second.ports.end();
+      entity_t::portmap_t::const_iterator pitr = entity.ports.begin(), peitr = entity.ports.end();
       pitr != peitr;
       ++pitr
     )
     {
       unsigned long portnum(pitr->first);
-      ost << "\tport[" << std::dec << portnum << "]: " << 
-        pitr->second->label() << " <--> " <<
-        (pitr->second->connection ? pitr->second->connection->label() : "None" ) << 
-        std::endl;
+      
+      label.clear();
+      pitr->second->append_label(label);
+      label.append(" <--> ");
+      if(pitr->second->connection)
+        pitr->second->connection->append_label(label);
+      else
+        label.append("None");
+      
+      ost << "\tport[" << std::dec << portnum << "]: " << label << std::endl;
     }
   }
 }
 
-fabric_t::~fabric_t()
-{
+const uint32_t fabric_t::snapshot_version = 1;
+
+/**
+ * @brief binary snapshot header
+ * payload follows header and is covered by checksum
+ */
+struct snapshot_header_t {
+  char magic[8];
+  uint32_t version;
   /**
-    * Walk every port and release
-    */
-  for(
-    portmap_guidport_t::const_iterator
-      itr = portmap.begin(),
-      eitr = portmap.end();
-    itr != eitr;
-    ++itr
+   * @brief 0x01020304 in byte order of writer
+   */
+  uint32_t byte_order;
+  /**
+   * @brief payload size in bytes
+   */
+  uint64_t size;
+  /**
+   * @brief checksum of payload
+   */
+  uint64_t checksum;
+};
+
+/**
+ * @brief number of records in every payload section
+ */
+struct snapshot_counts_t {
+  uint32_t names;
+  uint32_t name_bytes;
+  uint32_t ports;
+  uint32_t entities;
+  uint32_t lid_pages;
+  uint32_t lft_pages;
+  uint8_t lmc;
+  uint8_t exact_lids;
+  uint8_t reserved[6];
+};
+
+/**
+ * @brief saved port
+ */
+struct snapshot_port_t {
+  uint64_t guid;
+  uint64_t lid;
+  /**
+   * @brief index of name in saved names
+   */
+  uint32_t name;
+  /**
+   * @brief index of connected port (fabric_t::no_port if dark)
+   */
+  uint32_t remote;
+  uint8_t port;
+  uint8_t type;
+  uint8_t hca;
+  uint8_t lmc;
+  uint8_t width;
+  uint8_t speed;
+  uint8_t leaf;
+  uint8_t spine;
+};
+
+/**
+ * @brief saved entity (in entity id order)
+ */
+struct snapshot_entity_t {
+  uint64_t guid;
+  uint32_t type;
+  /**
+   * @brief number of PLFTs (LFT pages of higher PLFTs are invalid)
+   */
+  uint32_t plfts;
+};
+
+/**
+ * @brief saved table page header
+ * lid pages are followed by owner entities and then owner ports
+ * LFT pages are followed by egress ports
+ */
+struct snapshot_page_t {
+  uint64_t index;
+  uint32_t entity;
+  uint8_t plft;
+  uint8_t reserved[3];
+};
+
+static const char snapshot_magic[8] = { 'I', 'B', 'F', 'A', 'B', 'R', 'I', 'C' };
+static const uint32_t snapshot_byte_order = 0x01020304;
+
+/**
+ * @brief payload is read in blocks of this size
+ * a corrupt payload size can not allocate more than the stream holds
+ */
+static const size_t snapshot_block_size = 1 << 20;
+
+/**
+ * @brief highest page index of a saved table (32 bit LIDs)
+ */
+static const uint64_t snapshot_max_page = MAX_LID_VALUE >> entity_t::unicast_forwarding_table_t::ports_t::page_bits;
+
+/**
+ * @brief FNV-1a over 64 bit words (then trailing bytes)
+ */
+static uint64_t snapshot_checksum(const char * const data, const size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  
+  for(; i < size; ++i)
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+  
+  return hash;
+}
+
+template<typename T>
+static void snapshot_append(std::string &buffer, const T * const data, const size_t count)
+{
+  if(count)
+    buffer.append(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+
+template<typename T>
+static bool snapshot_read(const std::string &buffer, size_t &offset, T * const data, const size_t count)
+{
+  if(count > (buffer.size() - offset) / sizeof(T))
+    return false;
+  
+  ///empty sections have no array
+  if(!count)
+    return true;
+  
+  memcpy(data, buffer.data() + offset, count * sizeof(T));
+  offset += count * sizeof(T);
+  return true;
+}
+
+/**
+ * @brief read section into container
+ * container is only resized once buffer is known to hold count values
+ */
+template<typename C>
+static bool snapshot_read_section(const std::string &buffer, size_t &offset, C &data, const size_t count)
+{
+  if(count > (buffer.size() - offset) / sizeof(typename C::value_type))
+    return false;
+  
+  data.resize(count);
+  return snapshot_read(buffer, offset, data.empty() ? NULL : &data[0], data.size());
+}
+
+bool fabric_t::save(std::ostream &os) const
+{
+  typedef lidindex_t::page_t lid_page_t;
+  typedef entity_t::unicast_forwarding_table_t::ports_t lft_t;
+  
+  snapshot_counts_t counts;
+  memset(&counts, 0, sizeof(counts));
+  counts.lmc = lmc;
+  counts.exact_lids = port_lids_exact ? 1 : 0;
+  
+  ///every name and port gets the index of its first use
+  std::map<string_id_t, uint32_t> names;
+  std::vector<uint32_t> name_lengths;
+  std::string name_bytes;
+  std::map<const port_t *, uint32_t> indexes;
+  
+  for(portmap_guidport_t::const_iterator itr = portmap.begin(); itr != portmap.end(); ++itr)
+  {
+    indexes.insert(std::make_pair(itr->second, static_cast<uint32_t>(indexes.size())));
+    
+    if(names.insert(std::make_pair(itr->second->name, static_cast<uint32_t>(names.size()))).second)
+    {
+      const std::string &name = itr->second->get_name();
+      name_lengths.push_back(static_cast<uint32_t>(name.size()));
+      name_bytes.append(name);
+    }
+  }
+  
+  std::vector<snapshot_port_t> ports;
+  ports.reserve(portmap.size());
+  for(portmap_guidport_t::const_iterator itr = portmap.begin(); itr != portmap.end(); ++itr)
+  {
+    const port_t &port = *itr->second;
+    
+    snapshot_port_t saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.guid = port.guid;
+    saved.lid = port.lid;
+    saved.name = names[port.name];
+    saved.remote = port.connection ? indexes[port.connection] : no_port;
+    saved.port = port.port;
+    saved.type = static_cast<uint8_t>(port.type);
+    saved.hca = port.hca;
+    saved.lmc = port.lmc;
+    ///unrecognized speed and width strings are not saved
+    saved.width = static_cast<uint8_t>(port_width::is_known(port.width) ? port.width : port_width::UNKNOWN);
+    saved.speed = static_cast<uint8_t>(port_speed::is_known(port.speed) ? port.speed : port_speed::UNKNOWN);
+    saved.leaf = port.leaf;
+    saved.spine = port.spine;
+    ports.push_back(saved);
+  }
+  
+  std::vector<snapshot_entity_t> saved_entities(entities.size());
+  for(size_t i = 0; i < entities.size(); ++i)
+  {
+    memset(&saved_entities[i], 0, sizeof(snapshot_entity_t));
+    saved_entities[i].guid = entities[i].guid;
+    saved_entities[i].type = static_cast<uint32_t>(entities[i].get_type());
+    saved_entities[i].plfts = static_cast<uint32_t>(entities[i].get_plft_count());
+  }
+  
+  counts.names = static_cast<uint32_t>(name_lengths.size());
+  counts.name_bytes = static_cast<uint32_t>(name_bytes.size());
+  counts.ports = static_cast<uint32_t>(ports.size());
+  counts.entities = static_cast<uint32_t>(saved_entities.size());
+  
+  ///pages are written after the counts are known
+  std::string pages;
+  std::vector<uint32_t> owners(lidindex_t::page_size);
+  std::vector<port_num_t> owner_ports(lidindex_t::page_size);
+  
+  for(size_t dir = lidmap.next_page(0); dir < lidmap.get_directory_size(); dir = lidmap.next_page(dir + 1))
+  {
+    const lid_page_t * const page = lidmap.get_page(dir);
+    
+    snapshot_page_t header;
+    memset(&header, 0, sizeof(header));
+    header.index = dir;
+    snapshot_append(pages, &header, 1);
+    
+    for(size_t i = 0; i < lidindex_t::page_size; ++i)
+    {
+      owners[i] = page->values[i].entity;
+      owner_ports[i] = page->values[i].port;
+    }
+    snapshot_append(pages, &owners.front(), owners.size());
+    snapshot_append(pages, &owner_ports.front(), owner_ports.size());
+    ++counts.lid_pages;
+  }
+  
+  for(size_t id = 0; id < entities.size(); ++id)
+    for(size_t plft = 0; plft < entities[id].get_plft_count(); ++plft)
+    {
+      const lft_t &table = entities[id].get_uft(static_cast<plft_num_t>(plft)).get_ports();
+      
+      for(size_t dir = table.next_page(0); dir < table.get_directory_size(); dir = table.next_page(dir + 1))
+      {
+        const lft_t::page_t * const page = table.get_page(dir);
+        
+        snapshot_page_t header;
+        memset(&header, 0, sizeof(header));
+        header.index = dir;
+        header.entity = static_cast<uint32_t>(id);
+        header.plft = static_cast<uint8_t>(plft);
+        snapshot_append(pages, &header, 1);
+        snapshot_append(pages, page->values, lft_t::page_size);
+        ++counts.lft_pages;
+      }
+    }
+  
+  std::string payload;
+  payload.reserve(
+    sizeof(counts) + name_lengths.size() * sizeof(uint32_t) + name_bytes.size() + 
+    ports.size() * sizeof(snapshot_port_t) + saved_entities.size() * sizeof(snapshot_entity_t) + pages.size()
+  );
+  snapshot_append(payload, &counts, 1);
+  snapshot_append(payload, name_lengths.empty() ? NULL : &name_lengths.front(), name_lengths.size());
+  snapshot_append(payload, name_bytes.data(), name_bytes.size());
+  snapshot_append(payload, ports.empty() ? NULL : &ports.front(), ports.size());
+  snapshot_append(payload, saved_entities.empty() ? NULL : &saved_entities.front(), saved_entities.size());
+  payload.append(pages);
+  
+  snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+  header.version = snapshot_version;
+  header.byte_order = snapshot_byte_order;
+  header.size = payload.size();
+  header.checksum = snapshot_checksum(payload.data(), payload.size());
+  
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  os.write(payload.data(), payload.size());
+  
+  return static_cast<bool>(os);
+}
+
+bool fabric_t::load(std::istream &is)
+{
+  if(!entities.empty() || !portmap.empty())
+  {
+    std::cerr << "snapshot can only be loaded into an empty fabric" << std::endl;
+    return false;
+  }
+  
+  ///Snapshot is loaded aside so a failure leaves this fabric empty
+  fabric_t fabric;
+  fabric.page_store = page_store;
+  if(!fabric.read_snapshot(is))
+    return false;
+  
+  *this = std::move(fabric);
+  return true;
+}
+
+bool fabric_t::read_snapshot(std::istream &is)
+{
+  typedef entity_t::unicast_forwarding_table_t::ports_t lft_t;
+  
+  snapshot_header_t header;
+  if(!is.read(reinterpret_cast<char *>(&header), sizeof(header)) || memcmp(header.magic, snapshot_magic, sizeof(header.magic)))
+  {
+    std::cerr << "not a fabric snapshot" << std::endl;
+    return false;
+  }
+  
+  if(header.byte_order != snapshot_byte_order || header.version != snapshot_version)
+  {
+    std::cerr << "unsupported fabric snapshot version " << header.version << std::endl;
+    return false;
+  }
+  
+  ///Whole payload is read before parsing (in blocks to never trust the size)
+  std::string payload;
+  while(payload.size() < header.size)
+  {
+    const size_t start = payload.size();
+    const size_t block = static_cast<size_t>(std::min<uint64_t>(snapshot_block_size, header.size - start));
+    
+    payload.resize(start + block);
+    if(!is.read(&payload[start], block))
+    {
+      std::cerr << "truncated fabric snapshot" << std::endl;
+      return false;
+    }
+  }
+  
+  if(snapshot_checksum(payload.data(), payload.size()) != header.checksum)
+  {
+    std::cerr << "fabric snapshot checksum mismatch" << std::endl;
+    return false;
+  }
+  
+  size_t offset = 0;
+  snapshot_counts_t counts;
+  std::vector<uint32_t> name_lengths;
+  std::string name_bytes;
+  std::vector<snapshot_port_t> ports;
+  std::vector<snapshot_entity_t> saved_entities;
+  
+  if(
+    !snapshot_read(payload, offset, &counts, 1) ||
+    !snapshot_read_section(payload, offset, name_lengths, counts.names) ||
+    !snapshot_read_section(payload, offset, name_bytes, counts.name_bytes) ||
+    !snapshot_read_section(payload, offset, ports, counts.ports) ||
+    !snapshot_read_section(payload, offset, saved_entities, counts.entities)
   )
-    delete itr->second;
+  {
+    std::cerr << "truncated fabric snapshot" << std::endl;
+    return false;
+  }
+  
+  ///Intern every name
+  std::vector<string_id_t> names(counts.names);
+  {
+    size_t start = 0;
+    for(size_t i = 0; i < names.size(); ++i)
+    {
+      if(name_lengths[i] > name_bytes.size() - start)
+        return false;
+      
+      names[i] = port_t::get_name_table().intern(name_bytes.substr(start, name_lengths[i]));
+      start += name_lengths[i];
+    }
+  }
+  
+  ///Create every port in the arena then connect cables
+  std::vector<port_t *> created(ports.size(), NULL);
+  portmap_guidport_t loaded;
+  for(size_t i = 0; i < ports.size(); ++i)
+  {
+    const snapshot_port_t &saved = ports[i];
+    
+    if(
+      saved.name >= names.size() || (saved.remote != no_port && saved.remote >= ports.size()) ||
+      saved.type > port_type::TCA || saved.width > port_width::X12 || saved.speed > port_speed::XDR
+    )
+    {
+      std::cerr << "invalid port " << i << " in fabric snapshot" << std::endl;
+      return false;
+    }
+    
+    port_t port;
+    port.guid = saved.guid;
+    port.lid = saved.lid;
+    port.name = names[saved.name];
+    port.port = saved.port;
+    port.type = static_cast<port_type::type_t>(saved.type);
+    port.hca = saved.hca;
+    port.lmc = saved.lmc;
+    port.width = static_cast<port_width::width_t>(saved.width);
+    port.speed = static_cast<port_speed::speed_t>(saved.speed);
+    port.leaf = saved.leaf;
+    port.spine = saved.spine;
+    port.connection = NULL;
+    
+    created[i] = arena.create(port);
+    if(!loaded.insert(std::make_pair(created[i], created[i])).second)
+    {
+      std::cerr << "duplicate port " << i << " in fabric snapshot" << std::endl;
+      return false;
+    }
+  }
+  
+  for(size_t i = 0; i < ports.size(); ++i)
+    if(ports[i].remote != no_port)
+    {
+      if(ports[ports[i].remote].remote != i)
+      {
+        std::cerr << "invalid cable of port " << i << " in fabric snapshot" << std::endl;
+        return false;
+      }
+      
+      created[i]->connection = created[ports[i].remote];
+    }
+  
+  ///entities are created first to keep their ids
+  for(size_t i = 0; i < saved_entities.size(); ++i)
+  {
+    const snapshot_entity_t &saved = saved_entities[i];
+    
+    if(!saved.guid || (saved.type != port_type::HCA && saved.type != port_type::TCA))
+    {
+      std::cerr << "invalid entity " << i << " in fabric snapshot" << std::endl;
+      return false;
+    }
+    
+    find_entity(saved.guid, static_cast<entity_t::type_t>(saved.type), true);
+  }
+  
+  if(!add_cables(loaded) || entities.size() != saved_entities.size())
+    return false;
+  
+  lmc = counts.lmc;
+  port_lids_exact = counts.exact_lids != 0;
+  
+  ///Lid map
+  {
+    lidindex_t::page_t page;
+    std::vector<uint32_t> owners(lidindex_t::page_size);
+    std::vector<port_num_t> owner_ports(lidindex_t::page_size);
+    
+    for(uint32_t p = 0; p < counts.lid_pages; ++p)
+    {
+      snapshot_page_t saved;
+      if(
+        !snapshot_read(payload, offset, &saved, 1) ||
+        !snapshot_read(payload, offset, &owners.front(), owners.size()) ||
+        !snapshot_read(payload, offset, &owner_ports.front(), owner_ports.size())
+      )
+      {
+        std::cerr << "truncated fabric snapshot" << std::endl;
+        return false;
+      }
+      
+      if(saved.index > snapshot_max_page)
+      {
+        std::cerr << "invalid lid page " << saved.index << " in fabric snapshot" << std::endl;
+        return false;
+      }
+      
+      for(size_t i = 0; i < lidindex_t::page_size; ++i)
+      {
+        if(owners[i] != no_entity && owners[i] >= entities.size())
+          return false;
+        
+        page.values[i].entity = owners[i];
+        page.values[i].port = owner_ports[i];
+      }
+      
+      lidmap.set_page(static_cast<size_t>(saved.index), page);
+    }
+  }
+  
+  if(!build_port_index())
+    return false;
+  
+  ///Routes
+  {
+    lft_t::page_t page;
+    
+    for(uint32_t p = 0; p < counts.lft_pages; ++p)
+    {
+      snapshot_page_t saved;
+      if(
+        !snapshot_read(payload, offset, &saved, 1) ||
+        !snapshot_read(payload, offset, page.values, lft_t::page_size)
+      )
+      {
+        std::cerr << "truncated fabric snapshot" << std::endl;
+        return false;
+      }
+      
+      if(
+        saved.entity >= entities.size() || saved.index > snapshot_max_page || 
+        saved.plft >= saved_entities[saved.entity].plfts
+      )
+      {
+        std::cerr << "invalid forwarding table page " << saved.index << " in fabric snapshot" << std::endl;
+        return false;
+      }
+      
+      ///route map is rebuilt from the pages when first used
+      if(!entities[saved.entity].set_route_page(static_cast<size_t>(saved.index), page, saved.plft))
+        return false;
+    }
+  }
+  
+  if(offset != payload.size())
+  {
+    std::cerr << "trailing data in fabric snapshot" << std::endl;
+    return false;
+  }
+  
+  return build_forwarding_table();
 }
 
-bool entity_t::add_route(const port_num_t port, const lid_t lid)
+fabric_t::~fabric_t()
 {
-  std::pair<routes_t::mapped_type::iterator, bool> result = routes[port].insert(lid);
-  return result.second;
+  ///every port is released with the arena
+}
+
+void fabric_t::release_port(port_t * const port)
+{
+  ///arena ports are only released with the arena
+  if(!arena.owns(port))
+    delete port;
+}
+
+bool entity_t::add_route(const port_num_t port, const lid_t lid, const plft_num_t plft)
+{
+  ///Fill forwarding table directly (copy it first if shared with another PLFT)
+  if(plft >= ufts.size())
+    ufts.resize(static_cast<size_t>(plft) + 1);
+  if(!ufts[plft])
+  {
+    ufts[plft].reset(new unicast_forwarding_table_t());
+    ufts[plft]->set_store(page_store);
+  }
+  else if(!ufts[plft].unique())
+    ufts[plft].reset(new unicast_forwarding_table_t(*ufts[plft]));
+  
+  const port_num_t previous = ufts[plft]->find(lid);
+  if(!ufts[plft]->set(lid, port))
+  {
+    std::cerr << "unable to add route to lid " << lid << " on " << get_label() << 
+      (lid > MAX_LID_VALUE ? ": lid out of range" : ": page store is full") << std::endl;
+    return false;
+  }
+  
+  ///compiled tables are stale now
+  next_hops.clear();
+  
+  ///LID moved to another port: rebuild routes from the forwarding tables
+  if(previous != unicast_forwarding_table_t::unreachable && previous != port)
+  {
+    routes_stale = true;
+    return true;
+  }
+  
+  build_routes();
+  if(plft >= routes.size())
+    routes.resize(static_cast<size_t>(plft) + 1);
+  
+  return routes[plft][port].insert(lid).second;
+}
+
+bool entity_t::set_route_page(
+  const size_t index, 
+  const unicast_forwarding_table_t::ports_t::page_t &page, 
+  const plft_num_t plft
+)
+{
+  ///Fill forwarding table directly (copy it first if shared with another PLFT)
+  if(plft >= ufts.size())
+    ufts.resize(static_cast<size_t>(plft) + 1);
+  if(!ufts[plft])
+  {
+    ufts[plft].reset(new unicast_forwarding_table_t());
+    ufts[plft]->set_store(page_store);
+  }
+  else if(!ufts[plft].unique())
+    ufts[plft].reset(new unicast_forwarding_table_t(*ufts[plft]));
+  
+  if(!ufts[plft]->set_page(index, page))
+  {
+    std::cerr << "unable to add routes of page " << index << " on " << get_label() << ": page store is full" << std::endl;
+    return false;
+  }
+  
+  ///compiled tables and routes are stale now
+  next_hops.clear();
+  routes_stale = true;
+  
+  return true;
+}
+
+void entity_t::build_routes() const
+{
+  if(!routes_stale)
+    return;
+  
+  routes_stale = false;
+  routes.clear();
+  routes.resize(ufts.size());
+  
+  ///LIDs are added in ascending order so every lid set only appends ranges
+  for(size_t plft = 0; plft < ufts.size(); ++plft)
+  {
+    if(!ufts[plft])
+      continue;
+    
+    const unicast_forwarding_table_t::ports_t &egress = ufts[plft]->get_ports();
+    for(size_t dir = egress.next_page(0); dir < egress.get_directory_size(); dir = egress.next_page(dir + 1))
+    {
+      const unicast_forwarding_table_t::ports_t::page_t * const page = egress.get_page(dir);
+      
+      const lid_t base = static_cast<lid_t>(dir) << unicast_forwarding_table_t::ports_t::page_bits;
+      for(size_t i = 0; i < unicast_forwarding_table_t::ports_t::page_size; ++i)
+        if(page->values[i] != unicast_forwarding_table_t::unreachable)
+          routes[plft][page->values[i]].insert(base + i);
+    }
+  }
+}
+
+const entity_t::routes_t &entity_t::get_routes(const plft_num_t plft) const
+{
+  static const routes_t empty;
+  
+  build_routes();
+  if(plft >= routes.size())
+    return empty;
+  
+  return routes[plft];
+}
+
+const entity_t::unicast_forwarding_table_t &entity_t::get_uft(const plft_num_t plft) const
+{
+  static const unicast_forwarding_table_t empty;
+  
+  if(plft >= ufts.size() || !ufts[plft])
+    return empty;
+  
+  return *ufts[plft];
+}
+
+void entity_t::set_port_plft(const port_num_t port, const plft_num_t plft)
+{
+  if(port >= port_plfts.size())
+    port_plfts.resize(static_cast<size_t>(port) + 1, 0);
+  
+  port_plfts[port] = plft;
+}
+
+plft_num_t entity_t::get_port_plft(const port_num_t port) const
+{
+  return port < port_plfts.size() ? port_plfts[port] : 0;
+}
+
+const next_hop_table_t &entity_t::get_next_hops(const plft_num_t plft) const
+{
+  static const next_hop_table_t empty;
+  
+  if(plft >= next_hops.size() || !next_hops[plft])
+    return empty;
+  
+  return *next_hops[plft];
+}
+
+bool entity_t::build_next_hops(const fabric_t &fabric)
+{
+  ///tables are only kept once every PLFT is compiled
+  next_hops.clear();
+  std::vector<shared_next_hops_t> compiled(ufts.size());
+  
+  for(size_t plft = 0; plft < ufts.size(); ++plft)
+  {
+    if(!ufts[plft])
+      continue;
+    
+    ///PLFTs sharing a forwarding table share the compiled table
+    for(size_t i = 0; i < plft; ++i)
+      if(ufts[i] == ufts[plft])
+      {
+        compiled[plft] = compiled[i];
+        break;
+      }
+    if(compiled[plft])
+      continue;
+    
+    /**
+     * Resolve every egress port once
+     * then fill every LID from its port
+     */
+    next_hop_table_t::hop_t port_hops[port_array_t::max_ports];
+    std::fill(port_hops, port_hops + port_array_t::max_ports, next_hop_table_t::unreachable);
+    
+    for(
+      portmap_t::const_iterator
+        itr = ports.begin(),
+        eitr = ports.end();
+      itr != eitr;
+      ++itr
+    )
+    {
+      const port_t * const remote = itr->second->connection;
+      if(!remote)
+        continue; ///dark port
+      
+      const uint32_t id = fabric.get_entity_id(remote->guid);
+      if(id == fabric_t::no_entity || id > next_hop_table_t::max_entity)
+        return false;
+      
+      port_hops[itr->first] = next_hop_table_t::pack(id, remote->port);
+    }
+    
+    next_hop_table_t * const table = new next_hop_table_t();
+    compiled[plft].reset(table);
+    
+    ///Only walk the allocated LFT pages
+    const unicast_forwarding_table_t::ports_t &egress = ufts[plft]->get_ports();
+    for(size_t dir = egress.next_page(0); dir < egress.get_directory_size(); dir = egress.next_page(dir + 1))
+    {
+      const unicast_forwarding_table_t::ports_t::page_t * const page = egress.get_page(dir);
+      
+      const lid_t base = static_cast<lid_t>(dir) << unicast_forwarding_table_t::ports_t::page_bits;
+      for(size_t i = 0; i < unicast_forwarding_table_t::ports_t::page_size; ++i)
+        if(page->values[i] != unicast_forwarding_table_t::unreachable && !table->set(base + i, port_hops[page->values[i]]))
+          return false;
+    }
+  }
+  
+  next_hops.swap(compiled);
+  return true;
+}
+
+bool entity_t::add_multicast_route(const lid_t mlid, const port_num_t port)
+{
+  ///Size port masks for every port on the first route
+  if(mft.get_mlids().empty() && !ports.empty())
+    mft.set_radix(ports.max_port());
+  
+  return mft.add_port(mlid, port);
+}
+
+bool entity_t::add_adaptive_route(const adaptive_routing_table_t::group_t group, const port_num_t port)
+{
+  ///Size port masks for every port on the first group
+  if(art.get_group_count() == 0 && !ports.empty())
+    art.set_radix(ports.max_port());
+  
+  return art.add_group_port(group, port);
 }
 
+bool entity_t::get_egress_ports(const lid_t lid, adaptive_routing_table_t::ports_t &ports, const plft_num_t plft) const
+{
+  ports.clear();
+  
+  adaptive_routing_table_t::group_t group = 0;
+  if(art.find_group(lid, group, plft) && art.get_group_ports(group, ports) && !ports.empty())
+    return true;
+  
+  ///Fall back to static route
+  const port_num_t port = get_uft(plft).find(lid);
+  if(port == unicast_forwarding_table_t::unreachable)
+    return false;
+  
+  ports.push_back(port);
+  return true;
+}
+
+const uint32_t fabric_t::no_entity = 0xFFFFFFFF;
+const uint32_t fabric_t::no_port = 0xFFFFFFFF;
+const fabric_t::lid_owner_t fabric_t::unused_lid = { fabric_t::no_entity, 0 };
+
 fabric_t::fabric_t()
-  : lmc(0)
+  : lmc(0), port_lids_exact(false), lidmap(unused_lid), portrecords_stale(false)
 {
 }
 
-bool fabric_t::add_route(const guid_t guid, const port_num_t port, const lid_t lid)
+fabric_t::fabric_t(fabric_t &&other)
+  : lmc(other.lmc), port_lids_exact(other.port_lids_exact),
+    arena(std::move(other.arena)), entities(std::move(other.entities)), portmap(std::move(other.portmap)),
+    entityhash(std::move(other.entityhash)), porthash(std::move(other.porthash)), lidmap(std::move(other.lidmap)),
+    portindex(std::move(other.portindex)), portrecords(std::move(other.portrecords)), portrecords_stale(other.portrecords_stale), 
+    partitions(std::move(other.partitions)),
+    page_store(std::move(other.page_store))
+{
+  other.entities.clear();
+  other.portmap.clear();
+  other.lidmap.clear();
+  other.portindex.clear();
+  other.portrecords.clear();
+  other.portrecords_stale = false;
+  other.partitions.clear();
+  other.lmc = 0;
+  other.port_lids_exact = false;
+}
+
+fabric_t &fabric_t::operator=(fabric_t &&other)
+{
+  if(this == &other)
+    return *this;
+  
+  lmc = other.lmc;
+  port_lids_exact = other.port_lids_exact;
+  
+  ///everything pointing to ports goes before the arena destroys them
+  page_store = std::move(other.page_store);
+  partitions = std::move(other.partitions);
+  portrecords = std::move(other.portrecords);
+  portrecords_stale = other.portrecords_stale;
+  portindex = std::move(other.portindex);
+  lidmap = std::move(other.lidmap);
+  porthash = std::move(other.porthash);
+  entityhash = std::move(other.entityhash);
+  portmap = std::move(other.portmap);
+  entities = std::move(other.entities);
+  arena = std::move(other.arena);
+  
+  other.entities.clear();
+  other.portmap.clear();
+  other.lidmap.clear();
+  other.portindex.clear();
+  other.portrecords.clear();
+  other.portrecords_stale = false;
+  other.partitions.clear();
+  other.lmc = 0;
+  other.port_lids_exact = false;
+  
+  return *this;
+}
+
+bool fabric_t::add_route(const guid_t guid, const port_num_t port, const lid_t lid, const plft_num_t plft)
 {
   assert(guid > 0);
   assert(port > 0);
@@ -367,51 +1773,344 @@ bool fabric_t::add_route(const guid_t guid, const port_num_t port, const lid_t l
   assert(lidmap.size());
   
   ///Find source entity
-  entities_t::iterator itr = entities.find(guid);
-  assert(itr != entities.end());
+  entity_t * const entity = get_entity(guid);
+  assert(entity);
   
 #ifndef NDEBUG
   ///Find destination entity
-  entitiesmap_lid_t::iterator itr_lid = lidmap.find(lid);
-  //assert(itr_lid != lidmap.end()); ///routes arent always clean :(
+  const entity_t * const lid_entity = find_lid(lid);
+  //assert(lid_entity); ///routes arent always clean :(
 #endif
   
   ///Give route to source entity
-  if(itr != entities.end())
+  if(entity)
   {
 #ifndef NDEBUG
-    std::string tolid = "unkown";
-    if(itr_lid != lidmap.end())
-      tolid = itr_lid->second->label(entity_t::LABEL_ENTITY_ONLY);
-    std::cerr << "route: src: " << itr->second.label(entity_t::LABEL_ENTITY_ONLY) << " port:"<< regex::string_cast_uint(port) << " to " << tolid << std::endl;
+    static const std::string unknown_lid = "unkown";
+    const std::string &tolid = lid_entity ? lid_entity->get_label() : unknown_lid;
+    std::cerr << "route: src: " << entity->get_label() << " plft:" << regex::string_cast_uint(plft) << " port:"<< regex::string_cast_uint(port) << " to " << tolid << std::endl;
 #endif
-    return itr->second.add_route(port, lid);
+    return entity->add_route(port, lid, plft);
   }
   
   return false;
 }
 
+bool fabric_t::add_multicast_route(const guid_t guid, const lid_t mlid, const port_num_t port)
+{
+  assert(guid > 0);
+  assert(mlid > 0);
+  
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  ///same port may be given more than once
+  entity->add_multicast_route(mlid, port);
+  return true;
+}
+
+bool fabric_t::clear_multicast_routes()
+{
+  for(
+    entities_t::iterator 
+      itr = entities.begin(),
+      eitr = entities.end();
+    itr != eitr;
+    ++itr
+  )
+    itr->mft.clear();
+  
+  return true;
+}
+
+bool fabric_t::add_adaptive_route(const guid_t guid, const adaptive_routing_table_t::group_t group, const port_num_t port)
+{
+  assert(guid > 0);
+  
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  ///same port may be given more than once
+  entity->add_adaptive_route(group, port);
+  return true;
+}
+
+bool fabric_t::set_adaptive_route_group(
+  const guid_t guid, const lid_t lid, 
+  const adaptive_routing_table_t::group_t group, const plft_num_t plft
+)
+{
+  assert(guid > 0);
+  assert(lid > 0);
+  
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  entity->art.set_lid_group(lid, group, plft);
+  return true;
+}
+
+bool fabric_t::set_port_plft(const guid_t guid, const port_num_t port, const plft_num_t plft)
+{
+  assert(guid > 0);
+  
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  entity->set_port_plft(port, plft);
+  return true;
+}
+
+bool fabric_t::clear_adaptive_routes()
+{
+  for(
+    entities_t::iterator 
+      itr = entities.begin(),
+      eitr = entities.end();
+    itr != eitr;
+    ++itr
+  )
+    itr->art.clear();
+  
+  return true;
+}
+
+bool fabric_t::add_sl2vl(const guid_t guid, const port_num_t in, const port_num_t out, const sl2vl_tables_t::sl2vl_t table)
+{
+  assert(guid > 0);
+  
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  entity->sl2vl.set(in, out, table);
+  return true;
+}
+
+bool fabric_t::compact_sl2vl(const guid_t guid)
+{
+  entity_t * const entity = get_entity(guid);
+  if(!entity)
+    return false;
+  
+  entity->sl2vl.compact();
+  return true;
+}
+
+const entity_t * fabric_t::find_hca_leaf(const entity_t &hca, const port_t ** const port) const
+{
+  assert(hca.get_type() == port_type::HCA);
+  
+  if(hca.ports.empty() || !hca.ports.begin()->second->connection)
+    return NULL;
+  
+  const port_t * const first = hca.ports.begin()->second;
+  if(port)
+    *port = first;
+  
+  return get_entity(first->connection->guid);
+}
+
+bool fabric_t::expand_multicast_tree(const lid_t mlid, const entity_t &source, multicast_tree_t &tree) const
+{
+  typedef multicast_forwarding_table_t::mask_word_t mask_word_t;
+  ///switch and port number packet arrived on (0 for source switch)
+  typedef std::pair<const entity_t *, port_num_t> hop_t;
+  
+  tree.clear();
+  
+  std::deque<hop_t> queue;
+  std::set<const entity_t *> visited;
+  
+  if(source.get_type() == port_type::HCA)
+  {
+    const port_t *port = NULL;
+    const entity_t * const next = find_hca_leaf(source, &port);
+    if(!next)
+      return false;
+    
+    tree.links.push_back(multicast_tree_t::link_t(port, port->connection));
+    queue.push_back(hop_t(next, port->connection->port));
+  }
+  else
+    queue.push_back(hop_t(&source, 0));
+  
+  visited.insert(queue.front().first);
+  
+  while(!queue.empty())
+  {
+    const entity_t &entity = *queue.front().first;
+    const port_num_t in_port = queue.front().second;
+    queue.pop_front();
+    
+    tree.switches.push_back(&entity);
+    
+    const mask_word_t * const mask = entity.mft.find(mlid);
+    if(!mask) ///switch is not part of MLID tree
+      continue;
+    
+    const size_t words = entity.mft.get_mask_words();
+    for(size_t w = 0; w < words; ++w)
+      for(size_t bit = 0; bit < multicast_forwarding_table_t::mask_word_bits && (mask[w] >> bit); ++bit)
+      {
+        if(!(mask[w] & (static_cast<mask_word_t>(1) << bit)))
+          continue;
+        
+        const size_t port_num = w * multicast_forwarding_table_t::mask_word_bits + bit;
+        if(port_num == in_port)
+          continue;
+        
+        ///port 0 delivers to switch itself
+        if(port_num == 0)
+        {
+          tree.members.push_back(&entity);
+          continue;
+        }
+        
+        const port_t * const port = entity.ports.get(static_cast<port_num_t>(port_num));
+        if(!port || !port->connection)
+          continue; ///dark port
+        
+        const entity_t * const next = get_entity(port->connection->guid);
+        if(!next)
+          return false;
+        
+        tree.links.push_back(multicast_tree_t::link_t(port, port->connection));
+        
+        if(next->get_type() == port_type::HCA)
+          tree.members.push_back(next);
+        else if(visited.insert(next).second)
+          queue.push_back(hop_t(next, port->connection->port));
+        else
+          tree.loop = true;
+      }
+  }
+  
+  return true;
+}
+
+bool fabric_t::expand_adaptive_routes(const entity_t &start, const entity_t &end, adaptive_route_t &route, const plft_num_t plft) const
+{
+  ///switch and hops from start
+  typedef std::pair<const entity_t *, unsigned int> hop_t;
+  
+  route.clear();
+  
+  const lid_t lid = end.lid();
+  if(!lid)
+    return false;
+  
+  std::deque<hop_t> queue;
+  ///distance of every switch already queued
+  std::map<const entity_t *, unsigned int> visited;
+  
+  if(start.get_type() == port_type::HCA)
+  {
+    const entity_t * const next = find_hca_leaf(start);
+    if(!next)
+      return false;
+    
+    if(next == &end)
+    {
+      route.reached = true;
+      return true;
+    }
+    
+    queue.push_back(hop_t(next, 1));
+  }
+  else
+    queue.push_back(hop_t(&start, 0));
+  
+  visited.insert(queue.front());
+  
+  adaptive_routing_table_t::ports_t ports;
+  while(!queue.empty())
+  {
+    const entity_t &entity = *queue.front().first;
+    const unsigned int distance = queue.front().second;
+    queue.pop_front();
+    
+    if(&entity == &end)
+    {
+      route.reached = true;
+      continue;
+    }
+    
+    route.hops.push_back(adaptive_route_t::hop_t());
+    adaptive_route_t::hop_t &hop = route.hops.back();
+    hop.entity = &entity;
+    hop.distance = distance;
+    
+    if(!entity.get_egress_ports(lid, ports, plft))
+      continue; ///no route to lid
+    
+    for(size_t i = 0; i < ports.size(); ++i)
+    {
+      ///port 0 delivers to switch itself
+      if(ports[i] == 0)
+        continue;
+      
+      const port_t * const port = entity.ports.get(ports[i]);
+      if(!port || !port->connection)
+        continue; ///dark port
+      
+      hop.egress.push_back(port);
+      
+      const entity_t * const next = get_entity(port->connection->guid);
+      if(!next)
+        return false;
+      
+      if(next == &end)
+        route.reached = true;
+      else if(next->get_type() == port_type::HCA)
+        continue; ///misrouted to another HCA
+      else
+      {
+        std::pair<std::map<const entity_t *, unsigned int>::iterator, bool> result = 
+          visited.insert(std::make_pair(next, distance + 1));
+        
+        if(result.second)
+          queue.push_back(hop_t(next, distance + 1));
+        else if(result.first->second <= distance)
+          route.loop = true;
+      }
+    }
+  }
+  
+  return true;
+}
+
 bool fabric_t::build_lid_map(bool determine_lmc)
 {
   ///Always start clean
   clear_lidmap();
   
+  ///lids are walked from the port records
+  if(portindex.size() != portmap.size())
+  {
+    if(!build_port_index())
+      return false;
+  }
+  else if(!update_port_records())
+    return false;
+  
+  ///No need to guess when every lid is known
+  if(port_lids_exact)
+    return build_exact_lid_map();
+  
   {
     const lmc_t max_lmc_lid = lmc > 0 ? (1 << lmc) - 1 : 0;
     
-    /**
-    * Walk every entity and build lid map
-    */
-    for(
-      entities_t::iterator 
-        itr = entities.begin(),
-        eitr = entities.end();
-      itr != eitr;
-      ++itr
-    )
+    /**
+    * Walk every entity and build lid map
+    */
+    for(uint32_t index = 0; index < entities.size(); ++index)
     {
-      assert(itr->second.lid() > 0);
-      entity_t &entity = itr->second;
+      entity_t &entity = entities[index];
       const lid_t blid = entity.lid();
       assert(blid > 0);
       
@@ -419,28 +2118,38 @@ bool fabric_t::build_lid_map(bool determine_lmc)
         for(lmc_t i = 0; i <= max_lmc_lid; ++i)
         {
 #ifndef NDEBUG
-          std::cerr << "set HCA lid " << entity.label() << "(" << itr->first << std::hex << ") = " << regex::string_cast_uint(blid + i) << std::endl;
+          std::cerr << "set HCA lid " << entity.get_label() << "(" << entity.guid << std::hex << ") = " << regex::string_cast_uint(blid + i) << std::endl;
 #endif
-          assert(lidmap.find(blid + i) == lidmap.end());
-          lidmap[blid + i] = &entity;
+          const uint32_t existing = lidmap.find(blid + i).entity;
+          if(existing != no_entity && existing != index)
+          {
+            std::cerr << "lid " << blid + i << 
+              " given to both " << entities[existing].get_label() << 
+              " and " << entity.get_label() << 
+              " with fabric lmc = " << regex::string_cast_uint(lmc) << std::endl;
+            return false;
+          }
+          
+          if(!set_lid_owner(blid + i, index, entity.ports.begin()->first))
+            return false;
         }
       else 
         if(entity.get_type() == port_type::TCA) 
         { ///Switchs do not get a second LID
-#ifndef NDEBUG
+          const uint32_t existing = lidmap.find(blid).entity;
+          if(existing != no_entity && existing != index)
           {
-            entitiesmap_lid_t::iterator itr = lidmap.find(blid);
-            if(itr != lidmap.end())
-            {
-              std::cerr << "attempting fabric lmc = " << regex::string_cast_uint(lmc) << std::endl;
-              std::cerr << "found existing port " << itr->second->label() <<  " on lid " << blid << std::endl;
-              std::cerr << "was going to set port " << entity.label() <<  " on lid " << blid << std::endl;
-              abort();
-            }
+            std::cerr << "lid " << blid << 
+              " given to both " << entities[existing].get_label() << 
+              " and " << entity.get_label() << 
+              " with fabric lmc = " << regex::string_cast_uint(lmc) << std::endl;
+            return false;
           }
-          std::cerr << "set TCA lid " << entity.label() << "(" << itr->first << std::hex << ") = " << regex::string_cast_uint(blid) << std::endl;
+#ifndef NDEBUG
+          std::cerr << "set TCA lid " << entity.get_label() << "(" << entity.guid << std::hex << ") = " << regex::string_cast_uint(blid) << std::endl;
 #endif
-          lidmap[blid] = &entity;
+          if(!set_lid_owner(blid, index, 0))
+            return false;
         }
       else
         abort(); ///unknown port type?
@@ -467,33 +2176,32 @@ bool fabric_t::build_lid_map(bool determine_lmc)
     
     ///Start off assuming max LMC value
     lmc_t max_lmc_lid = (1 << MAX_LMC_VALUE) - 1;
-    entitiesmap_lid_t::const_iterator lid_end = lidmap.end();
     
     for(
-      portmap_guidport_t::const_iterator
-        itr = portmap.begin(),
-        eitr = portmap.end();
+      port_records_t::const_iterator
+        itr = portrecords.begin(),
+        eitr = portrecords.end();
       itr != eitr && max_lmc_lid > 0;
       ++itr
     )
       ///Only search LIDs of HCAs
-      if(itr->second->type == port_type::HCA)
+      if(itr->type == port_type::HCA)
       {
 #ifndef NDEBUG
-        std::cerr << "search port " << itr->second->label() << std::endl;
+        std::cerr << "search port " << portindex[itr - portrecords.begin()]->label() << std::endl;
 #endif
 
         ///walk until highest seen lmc value offset
         for(lmc_t i = 1; i <= max_lmc_lid; ++i)
         {
-          assert(itr->second->lid > 0);
-          assert(lidmap.find(itr->second->lid) != lid_end);
+          assert(itr->lid > 0);
+          assert(find_lid(itr->lid));
           
           ///is there lid on base lid + lmc offset
-          if(lidmap.find(itr->second->lid + i) != lid_end)
+          if(find_lid(itr->lid + i))
           {
 #ifndef NDEBUG
-            std::cerr << "found base lid " << itr->second->lid << " + " << regex::string_cast_uint(i) << " = " << itr->second->lid + i << " => collision\n";
+            std::cerr << "found base lid " << itr->lid << " + " << regex::string_cast_uint(i) << " = " << itr->lid + i << " => collision\n";
 #endif
             ///found collision, found new max lid offset
             max_lmc_lid = i - 1;
@@ -501,7 +2209,7 @@ bool fabric_t::build_lid_map(bool determine_lmc)
           }
 #ifndef NDEBUG
           else
-            std::cerr << "found base lid " << itr->second->lid << " + " << regex::string_cast_uint(i) << " = " << itr->second->lid + i << " => no collision\n";
+            std::cerr << "found base lid " << itr->lid << " + " << regex::string_cast_uint(i) << " = " << itr->lid + i << " => no collision\n";
 #endif
         }
       }
@@ -525,6 +2233,123 @@ bool fabric_t::build_lid_map(bool determine_lmc)
   return true;
 }
 
+bool fabric_t::build_exact_lid_map()
+{
+  lmc_t max_lmc = 0;
+  size_t lids = 0;
+  
+  for(
+    port_records_t::const_iterator
+      itr = portrecords.begin(),
+      eitr = portrecords.end();
+    itr != eitr;
+    ++itr
+  )
+  {
+    const port_record_t &port = *itr;
+    
+    ///Port without lid is not active
+    if(!port.lid)
+      continue;
+    
+    assert(port.entity < entities.size());
+    assert(port.lmc <= MAX_LMC_VALUE);
+    const lid_t lid_count = static_cast<lid_t>(1) << port.lmc;
+    
+    for(lid_t i = 0; i < lid_count; ++i)
+    {
+      const lid_t lid = port.lid + i;
+      const uint32_t existing = lidmap.find(lid).entity;
+      
+      ///every port of a switch shares the same lid
+      if(existing != no_entity && existing != port.entity)
+      {
+        std::cerr << "lid " << lid << 
+          " given to both " << entities[existing].get_label() << 
+          " and " << entities[port.entity].get_label() << std::endl;
+        return false;
+      }
+      
+      if(existing == no_entity)
+        ++lids;
+      
+      if(!set_lid_owner(lid, port.entity, port.type == port_type::TCA ? 0 : port.port))
+        return false;
+    }
+    
+    if(port.type == port_type::HCA && port.lmc > max_lmc)
+      max_lmc = port.lmc;
+  }
+  
+#ifndef NDEBUG
+  std::cerr << "exact fabric lmc = " << regex::string_cast_uint(max_lmc) << 
+    " lids = " << lids << std::endl;
+#endif
+  
+  lmc = max_lmc;
+  return true;
+}
+
+bool fabric_t::set_lmc(const lmc_t value)
+{
+  if(value > MAX_LMC_VALUE)
+  {
+    std::cerr << "invalid lmc " << regex::string_cast_uint(value) << std::endl;
+    return false;
+  }
+  
+  lmc = value;
+  return true;
+}
+
+bool fabric_t::set_lid_owner(const lid_t lid, const uint32_t entity, const port_num_t port)
+{
+  assert(entity < entities.size());
+  
+  if(lid > MAX_LID_VALUE)
+  {
+    std::cerr << "lid " << lid << " of " << entities[entity].get_label() << " is out of range" << std::endl;
+    return false;
+  }
+  
+  const lid_owner_t owner = { entity, port };
+  lid_owner_t previous = unused_lid;
+  lidmap.set(lid, owner, &previous);
+  return previous.entity == no_entity || previous.entity == entity;
+}
+
+bool fabric_t::find_lid(const lid_t lid, const entity_t *&entity, port_num_t &port) const
+{
+  const lid_owner_t &owner = lidmap.find(lid);
+  if(owner.entity == no_entity)
+    return false;
+  
+  entity = &entities[owner.entity];
+  port = owner.port;
+  return true;
+}
+
+bool fabric_t::set_port_lid(const guid_t guid, const port_num_t port, const lid_t lid, const lmc_t lmc)
+{
+  assert(guid > 0);
+  assert(port > 0);
+  assert(lid > 0);
+  
+  if(lmc > MAX_LMC_VALUE)
+    return false;
+  
+  port_t * const port_ptr = porthash.find(guid, port);
+  if(!port_ptr)
+    return false;
+  
+  port_ptr->lid = lid;
+  port_ptr->lmc = lmc;
+  port_lids_exact = true;
+  portrecords_stale = true;
+  
+  return true;
+}
+
 bool fabric_t::clear_lidmap()
 {
   lidmap.clear();
@@ -534,6 +2359,9 @@ bool fabric_t::clear_lidmap()
 bool entity_t::clear_routes()
 {
   routes.clear();
+  routes_stale = false;
+  ufts.clear();
+  next_hops.clear();
   return true;
 }
 
@@ -550,7 +2378,7 @@ bool fabric_t::clear_routes()
     ++itr
   )
   {
-    if(!itr->second.clear_routes())
+    if(!itr->clear_routes())
       return false;
   }
   
@@ -559,48 +2387,149 @@ bool fabric_t::clear_routes()
 
 bool entity_t::build_forwarding_table()
 {
-  uft.clear();
-  for(routes_t::iterator i=routes.begin();
-    i!=routes.end();
-    i++
-    )
+  for(size_t plft = 0; plft < ufts.size(); ++plft)
   {
-    port_num_t portnum = i->first;
-    for(std::set<lid_t>::iterator j=i->second.begin();
-      j!=i->second.end();
-      j++)
-    {
-      uft.insert(std::pair<lid_t, port_num_t>(*j, portnum));
-    }
+    if(!ufts[plft])
+      continue;
+    
+    ufts[plft]->shrink();
+    
+    ///Share table with any identical PLFT
+    for(size_t i = 0; i < plft; ++i)
+      if(ufts[i] && *ufts[i] == *ufts[plft])
+      {
+        ufts[plft] = ufts[i];
+        break;
+      }
   }
   return(true);
 }
 
+bool entity_t::share_pages(unicast_forwarding_table_t::ports_t::page_pool_t &pool)
+{
+  for(size_t plft = 0; plft < ufts.size(); ++plft)
+  {
+    if(!ufts[plft])
+      continue;
+    
+    ///Skip PLFTs already sharing a table
+    bool shared = false;
+    for(size_t i = 0; i < plft && !shared; ++i)
+      shared = ufts[i] == ufts[plft];
+    
+    if(!shared)
+      ufts[plft]->share(pool);
+  }
+  return true;
+}
+
+bool entity_t::set_page_store(
+  const std::shared_ptr<page_store_t> &store, 
+  unicast_forwarding_table_t::ports_t::moved_pages_t * const moved
+)
+{
+  page_store = store;
+  
+  ///tables shared between PLFTs are only copied once
+  unicast_forwarding_table_t::ports_t::moved_pages_t local;
+  for(size_t plft = 0; plft < ufts.size(); ++plft)
+    if(ufts[plft] && !ufts[plft]->set_store(store, moved ? moved : &local))
+      return false;
+  
+  return true;
+}
+
 bool fabric_t::build_forwarding_table()
 {
+  ///switches routed by the same SM mostly hold identical LFT pages
+  entity_t::unicast_forwarding_table_t::ports_t::page_pool_t pool;
+  
   for(entities_t::iterator i = entities.begin();
     i!=entities.end();
     i++)
   {
-    i->second.build_forwarding_table();
+    i->build_forwarding_table();
+    i->share_pages(pool);
   }
   return(true);
 } 
 
-entity_t& entity_t::forward(fabric_t& fabric, const entity_t& target)
+bool fabric_t::map_forwarding_tables(const std::string &directory)
+{
+  std::shared_ptr<page_store_t> store(new page_store_t());
+  if(!store->open(directory, sizeof(entity_t::unicast_forwarding_table_t::ports_t::page_t)))
+    return false;
+  
+  return set_page_store(store);
+}
+
+bool fabric_t::set_page_store(const std::shared_ptr<page_store_t> &store)
+{
+  page_store = store;
+  
+  ///pages shared between switches (build_forwarding_table()) are moved once
+  entity_t::unicast_forwarding_table_t::ports_t::moved_pages_t moved;
+  
+  for(entities_t::iterator i = entities.begin();
+    i!=entities.end();
+    i++)
+  {
+    if(!i->set_page_store(page_store, &moved))
+    {
+      std::cerr << "unable to move forwarding tables of " << i->get_label() << " into page store" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool fabric_t::build_next_hops()
+{
+  for(entities_t::iterator i = entities.begin();
+    i!=entities.end();
+    i++)
+  {
+    if(!i->build_next_hops(*this))
+    {
+      std::cerr << "unable to build next hops of " << i->get_label() << std::endl;
+      clear_next_hops();
+      return false;
+    }
+  }
+  return(true);
+}
+
+void fabric_t::clear_next_hops()
+{
+  for(entities_t::iterator i = entities.begin(); i != entities.end(); ++i)
+    i->clear_next_hops();
+}
+
+entity_t& entity_t::forward(fabric_t& fabric, const entity_t& target, const plft_num_t plft)
 {
   lid_t target_lid = target.lid();
-  unicast_forwarding_table_t::iterator outgoing_port_n_i = uft.find(target_lid);
-  assert(outgoing_port_n_i != uft.end());
-  port_num_t outgoing_port_num = outgoing_port_n_i->second;
-  portmap_t::iterator outgoing_port_i = ports.find(outgoing_port_num);
-  assert(outgoing_port_i != ports.end());
-  assert(outgoing_port_i->second);
-  assert(outgoing_port_i->second->connection);
-  lid_t next_lid = outgoing_port_i->second->connection->lid;
-  guid_t next_guid = outgoing_port_i->second->connection->guid;
-  fabric_t::entities_t::iterator next_entity = fabric.find_entity(next_guid);
-  return(next_entity->second);
+  
+  ///compiled next hop gives the neighbour directly
+  const next_hop_table_t::hop_t hop = get_next_hops(plft).find(target_lid);
+  if(hop != next_hop_table_t::unreachable)
+    return fabric.get_entity_by_id(next_hop_table_t::get_entity(hop));
+  
+  port_num_t outgoing_port_num = get_uft(plft).find(target_lid);
+  assert(outgoing_port_num != unicast_forwarding_table_t::unreachable);
+  const port_t * const outgoing_port = ports.get(outgoing_port_num);
+  assert(outgoing_port);
+  assert(outgoing_port->connection);
+  lid_t next_lid = outgoing_port->connection->lid;
+  
+  ///lid map holds owner of every active lid
+  entity_t * const next = fabric.find_lid(next_lid);
+  if(next)
+    return(*next);
+  
+  guid_t next_guid = outgoing_port->connection->guid;
+  entity_t * const next_entity = fabric.get_entity(next_guid);
+  assert(next_entity);
+  return(*next_entity);
 }
 
 unsigned int fabric_t::count_hops(const entity_t& start, const entity_t& end)
@@ -609,14 +2538,17 @@ unsigned int fabric_t::count_hops(const entity_t& start, const entity_t& end)
   const entity_t* left;
   const entity_t* right;
   entity_t* current;
+  ///port packet arrived on (0 for source switch)
+  port_num_t ingress = 0;
 
   //ibdiagnet2 doesn't write routing tables for HCAs
-  //For now, assume we have single port HCAs
-  //(or at least that we want to route out the first port)
   //FIXME: could do something smarter here
   if(start.get_type() == infiniband::port_type::HCA)
   {
-    left = &(find_entity(start.ports.begin()->second->connection->guid))->second;
+    const port_t *port = NULL;
+    left = find_hca_leaf(start, &port);
+    assert(left);
+    ingress = port->connection->port;
     hops++;
   }
   else
@@ -625,7 +2557,8 @@ unsigned int fabric_t::count_hops(const entity_t& start, const entity_t& end)
   }
   if(end.get_type() == infiniband::port_type::HCA)
   {
-    right = &(find_entity(end.ports.begin()->second->connection->guid))->second;
+    right = find_hca_leaf(end);
+    assert(right);
     hops++;
   }
   else
@@ -633,20 +2566,343 @@ unsigned int fabric_t::count_hops(const entity_t& start, const entity_t& end)
     right = &end;
   }
   current = const_cast<entity_t*>(left);
-  while(current->lid() != right->lid())
+  const lid_t right_lid = right->lid();
+  while(current->lid() != right_lid)
   {
-    current = &(current->forward(*this, *right));
+    const plft_num_t plft = current->get_port_plft(ingress);
+    
+    ///one load per hop once next hops are built
+    const next_hop_table_t::hop_t hop = current->get_next_hops(plft).find(right_lid);
+    if(hop != next_hop_table_t::unreachable)
+    {
+      current = &entities[next_hop_table_t::get_entity(hop)];
+      ingress = next_hop_table_t::get_port(hop);
+    }
+    else
+    {
+      const port_t * const egress = current->ports.get(current->get_uft(plft).find(right_lid));
+      assert(egress);
+      assert(egress->connection);
+      ingress = egress->connection->port;
+      current = &(current->forward(*this, *right, plft));
+    }
     hops++;
   }
   return(hops);
 
 }
 
+/**
+ * @brief set bit in port bitmap
+ */
+static void set_port_bit(fabric_t::port_bitmap_t &bitmap, const size_t index)
+{
+  bitmap[index / 64] |= static_cast<uint64_t>(1) << (index % 64);
+}
+
+/**
+ * @brief test bit in port bitmap
+ */
+static bool test_port_bit(const fabric_t::port_bitmap_t &bitmap, const size_t index)
+{
+  return bitmap[index / 64] & (static_cast<uint64_t>(1) << (index % 64));
+}
+
+/**
+ * @brief order ports in port index same as portmap
+ */
+static bool port_index_less(const port_t * const port, const port_t::key_guid_port_t &key)
+{
+  return port_t::key_guid_port_t(port) < key;
+}
+
+bool fabric_t::build_port_index()
+{
+  portindex_t previous;
+  previous.swap(portindex);
+  portindex.reserve(portmap.size());
+  
+  for(
+    portmap_guidport_t::const_iterator
+      itr = portmap.begin(),
+      eitr = portmap.end();
+    itr != eitr;
+    ++itr
+  )
+    portindex.push_back(itr->second);
+  
+  if(!update_port_records())
+    return false;
+  
+  ///move partition bitmaps over to the new index (ports are never removed from portmap)
+  const size_t words = (portindex.size() + 63) / 64;
+  for(
+    partitions_t::iterator
+      pitr = partitions.begin(),
+      epitr = partitions.end();
+    pitr != epitr;
+    ++pitr
+  )
+  {
+    partition_t remapped;
+    remapped.members.assign(words, 0);
+    remapped.full_members.assign(words, 0);
+    
+    for(size_t i = 0; i < previous.size(); ++i)
+    {
+      if(!test_port_bit(pitr->second.members, i))
+        continue;
+      
+      size_t index = 0;
+      if(!find_port_index(previous[i]->guid, previous[i]->port, index))
+      {
+        assert(false);
+        return false;
+      }
+      
+      set_port_bit(remapped.members, index);
+      if(test_port_bit(pitr->second.full_members, i))
+        set_port_bit(remapped.full_members, index);
+    }
+    
+    pitr->second.members.swap(remapped.members);
+    pitr->second.full_members.swap(remapped.full_members);
+  }
+  
+  return true;
+}
+
+bool fabric_t::update_port_records() const
+{
+  portrecords.clear();
+  portrecords.reserve(portindex.size());
+  
+  for(size_t i = 0; i < portindex.size(); ++i)
+  {
+    const port_t * const port = portindex[i];
+    
+    const uint32_t entity = get_entity_id(port->guid);
+    assert(entity != no_entity);
+    if(entity == no_entity)
+    {
+      portrecords.clear();
+      return false;
+    }
+    
+    if(port->lid > MAX_LID_VALUE)
+    {
+      std::cerr << "lid " << port->lid << " of " << port->label() << " is out of range" << std::endl;
+      portrecords.clear();
+      return false;
+    }
+    
+    port_record_t record;
+    record.guid = port->guid;
+    record.entity = entity;
+    record.remote = no_port;
+    record.lid = static_cast<uint32_t>(port->lid);
+    record.port = port->port;
+    record.type = static_cast<uint8_t>(port->type);
+    record.lmc = port->lmc;
+    portrecords.push_back(record);
+  }
+  
+  ///cables are resolved once every port has an index
+  for(size_t i = 0; i < portindex.size(); ++i)
+  {
+    const port_t * const remote = portindex[i]->connection;
+    
+    size_t index = 0;
+    if(remote && find_port_index(remote->guid, remote->port, index))
+      portrecords[i].remote = static_cast<uint32_t>(index);
+  }
+  
+  portrecords_stale = false;
+  return true;
+}
+
+bool fabric_t::find_port_index(const guid_t guid, const port_num_t port, size_t &index) const
+{
+  const port_t::key_guid_port_t key(guid, port);
+  portindex_t::const_iterator itr = std::lower_bound(portindex.begin(), portindex.end(), key, port_index_less);
+  
+  if(itr == portindex.end() || (*itr)->guid != guid || (*itr)->port != port)
+    return false;
+  
+  index = itr - portindex.begin();
+  return true;
+}
+
+bool fabric_t::add_pkey(const guid_t guid, const port_num_t port, const pkey_t pkey)
+{
+  if(portindex.size() != portmap.size() && !build_port_index())
+    return false;
+  
+  size_t index = 0;
+  if(!find_port_index(guid, port, index))
+    return false;
+  
+  ///pkey 0 is an unused pkey table entry
+  const pkey_t base = pkey & PKEY_BASE_MASK;
+  if(!base)
+    return true;
+  
+  partition_t &partition = partitions[base];
+  if(partition.members.empty())
+  {
+    const size_t words = (portindex.size() + 63) / 64;
+    partition.members.assign(words, 0);
+    partition.full_members.assign(words, 0);
+  }
+  
+  set_port_bit(partition.members, index);
+  if(pkey & PKEY_FULL_MEMBER)
+    set_port_bit(partition.full_members, index);
+  
+  return true;
+}
+
+bool fabric_t::clear_partitions()
+{
+  partitions.clear();
+  return true;
+}
+
+const fabric_t::port_records_t & fabric_t::get_port_records() const
+{
+  refresh_port_records();
+  return portrecords;
+}
+
+bool fabric_t::refresh_port_records() const
+{
+  return !portrecords_stale || update_port_records();
+}
+
+bool fabric_t::build_partition_reachability(const pkey_t pkey, reachability_t &matrix, const plft_num_t plft) const
+{
+  if(!refresh_port_records())
+    return false;
+  
+  const size_t words = (portindex.size() + 63) / 64;
+  matrix.assign(portindex.size(), port_bitmap_t(words, 0));
+  
+  partitions_t::const_iterator pitr = partitions.find(pkey & PKEY_BASE_MASK);
+  if(pitr == partitions.end())
+    return true; ///nobody is a member
+  const partition_t &partition = pitr->second;
+  
+  /**
+   * Give every switch a dense id and a bitmap
+   * of every HCA port cabled to it
+   */
+  static const size_t no_switch = static_cast<size_t>(-1);
+  std::vector<size_t> switch_ids(entities.size(), no_switch); ///indexed by entity id
+  std::vector<const entity_t *> switches;
+  for(size_t id = 0; id < entities.size(); ++id)
+    if(entities[id].get_type() == port_type::TCA)
+    {
+      switch_ids[id] = switches.size();
+      switches.push_back(&entities[id]);
+    }
+  
+  std::vector<port_bitmap_t> attached(switches.size(), port_bitmap_t(words, 0));
+  for(size_t i = 0; i < portrecords.size(); ++i)
+  {
+    const port_record_t &port = portrecords[i];
+    if(port.type != port_type::HCA || port.remote == no_port)
+      continue;
+    
+    const size_t sid = switch_ids[portrecords[port.remote].entity];
+    if(sid != no_switch)
+      set_port_bit(attached[sid], i);
+  }
+  
+  /**
+   * Walk forwarding tables from every switch toward 
+   * every destination and remember result of every
+   * switch along the way so each switch is walked once
+   */
+  enum { UNKNOWN = 0, VISITING, REACH, NO_REACH };
+  std::vector<char> state(switches.size());
+  std::vector<size_t> path;
+  
+  for(size_t d = 0; d < portrecords.size(); ++d)
+  {
+    const port_t * const destination = portindex[d];
+    const port_record_t &record = portrecords[d];
+    if(record.type != port_type::HCA || !test_port_bit(partition.members, d))
+      continue;
+    
+    ///limited members may only talk to full members
+    const port_bitmap_t &allowed = test_port_bit(partition.full_members, d) ? 
+      partition.members : partition.full_members;
+    
+    port_bitmap_t &row = matrix[d];
+    std::fill(state.begin(), state.end(), UNKNOWN);
+    
+    for(size_t s = 0; s < switches.size(); ++s)
+    {
+      size_t current = s;
+      char result = NO_REACH;
+      path.clear();
+      
+      while(state[current] == UNKNOWN)
+      {
+        state[current] = VISITING;
+        path.push_back(current);
+        
+        const entity_t &entity = *switches[current];
+        const port_num_t out = entity.get_uft(plft).find(record.lid);
+        if(out == entity_t::unicast_forwarding_table_t::unreachable)
+          break;
+        
+        const port_t * const egress = entity.ports.get(out);
+        if(!egress || !egress->connection)
+          break;
+        
+        const port_t * const next = egress->connection;
+        if(next == destination)
+        {
+          result = REACH;
+          break;
+        }
+        
+        const uint32_t id = get_entity_id(next->guid);
+        if(id == no_entity || switch_ids[id] == no_switch)
+          break; ///delivered to wrong HCA
+        
+        current = switch_ids[id];
+      }
+      
+      ///walk ended on switch with known result (VISITING is a loop)
+      if(state[current] == REACH || state[current] == NO_REACH)
+        result = state[current];
+      
+      for(size_t i = 0; i < path.size(); ++i)
+        state[path[i]] = result;
+      
+      if(state[s] == REACH)
+        for(size_t w = 0; w < words; ++w)
+          row[w] |= attached[s][w];
+    }
+    
+    ///HCAs cabled together without switches
+    if(record.remote != no_port && portrecords[record.remote].type == port_type::HCA)
+      set_port_bit(row, record.remote);
+    
+    for(size_t w = 0; w < words; ++w)
+      row[w] &= allowed[w];
+  }
+  
+  return true;
+}
+
 port_t* fabric_t::find_port(guid_t guid, port_num_t port)
 {
-  portmap_guidport_t::iterator i = portmap.find(port_t::key_guid_port_t(guid,port));
-  if(i==portmap.end()) abort();
-  return((i->second));
+  port_t * const i = porthash.find(guid, port);
+  if(!i) abort();
+  return(i);
 }
 
 port_t* fabric_t::get_connection(port_t* port)
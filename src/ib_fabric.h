@@ -31,7 +31,10 @@
 #pragma once
 
 #include "ib_port.h"
+#include "ib_paged_table.h"
 #include<set>
+#include<memory>
+#include<iterator>
 
 #ifndef IB_FABRIC_H
 #define IB_FABRIC_H
@@ -39,6 +42,918 @@
 namespace infiniband {
 class fabric_t;
 
+/**
+ * @brief array of port masks
+ * Every port mask is a fixed number of 64bit words sized 
+ * to the switch radix (bit n = port n) and all masks are
+ * stored contiguously by mask index
+ */
+class port_masks_t
+{
+public:
+  /**
+   * @brief single word of a port mask
+   */
+  typedef uint64_t mask_word_t;
+  /**
+   * @brief list of port numbers
+   */
+  typedef std::vector<port_num_t> ports_t;
+  
+  /**
+   * @brief bits per mask word
+   */
+  static const size_t mask_word_bits;
+  
+  /**
+   * @brief ctor
+   */
+  port_masks_t();
+  
+  /**
+   * @brief set switch radix
+   * @param radix highest port number of switch
+   * @note existing port masks are widened if needed
+   */
+  void set_radix(const port_num_t radix);
+  
+  /**
+   * @brief add port to port mask
+   * @param mask mask index (masks up to index are added if needed)
+   * @param port port number
+   * @return true if port was not already in port mask
+   */
+  bool add_port(const size_t mask, const port_num_t port);
+  
+  /**
+   * @brief check if port is in port mask
+   * @param mask mask index
+   * @param port port number
+   * @return true if port is in port mask
+   */
+  bool has_port(const size_t mask, const port_num_t port) const;
+  
+  /**
+   * @brief get port mask
+   * @param mask mask index
+   * @return ptr to get_mask_words() words or NULL if mask is not known
+   */
+  const mask_word_t * get(const size_t mask) const;
+  
+  /**
+   * @brief get every port of port mask
+   * @param mask mask index
+   * @param ports list to append port numbers to (ascending)
+   * @return true if mask is known
+   */
+  bool get_ports(const size_t mask, ports_t &ports) const;
+  
+  /**
+   * @brief get number of words per port mask
+   */
+  size_t get_mask_words() const { return mask_words; }
+  
+  /**
+   * @brief get number of port masks
+   */
+  size_t size() const { return masks.size() / mask_words; }
+  
+  /**
+   * @brief clear every port mask
+   */
+  void clear() { masks.clear(); }
+  
+private:
+  /**
+   * @brief words per port mask
+   */
+  size_t mask_words;
+  
+  /**
+   * @brief every port mask
+   */
+  std::vector<mask_word_t> masks;
+};
+
+/**
+ * @brief multicast forwarding table (MFT)
+ * Holds a port mask for every MLID routed by a switch
+ * 
+ * Port masks are stored in MLID insertion order
+ */
+class multicast_forwarding_table_t
+{
+public:
+  /**
+   * @brief single word of a port mask
+   */
+  typedef port_masks_t::mask_word_t mask_word_t;
+  /**
+   * @brief map of MLID -> index of port mask in masks
+   */
+  typedef std::map<lid_t, size_t> mlid_index_t;
+  
+  /**
+   * @brief bits per mask word
+   */
+  static const size_t mask_word_bits;
+  
+  /**
+   * @brief ctor
+   */
+  multicast_forwarding_table_t();
+  
+  /**
+   * @brief set switch radix
+   * @param radix highest port number of switch
+   * @note existing port masks are widened if needed
+   */
+  void set_radix(const port_num_t radix);
+  
+  /**
+   * @brief add port to MLID port mask
+   * @param mlid multicast lid
+   * @param port port number to forward MLID to
+   * @return true if port was not already in port mask
+   */
+  bool add_port(const lid_t mlid, const port_num_t port);
+  
+  /**
+   * @brief check if MLID is forwarded to port
+   * @param mlid multicast lid
+   * @param port port number
+   * @return true if port is in MLID port mask
+   */
+  bool has_port(const lid_t mlid, const port_num_t port) const;
+  
+  /**
+   * @brief find port mask of MLID
+   * @param mlid multicast lid
+   * @return ptr to get_mask_words() words or NULL if MLID is not known
+   */
+  const mask_word_t * find(const lid_t mlid) const;
+  
+  /**
+   * @brief get number of words per port mask
+   */
+  size_t get_mask_words() const { return masks.get_mask_words(); }
+  
+  /**
+   * @brief get every known MLID
+   */
+  const mlid_index_t &get_mlids() const { return mlids; }
+  
+  /**
+   * @brief clear every MLID
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief MLID -> port mask index
+   */
+  mlid_index_t mlids;
+  
+  /**
+   * @brief every port mask
+   */
+  port_masks_t masks;
+};
+
+/**
+ * @brief sorted set of LIDs stored as runs
+ * Holds every LID as inclusive ranges of sequential LIDs
+ * 
+ * Routes mostly give sequential LIDs to the same port (and LIDs
+ * are given in ascending order) so a port usually needs only a
+ * few ranges. Iteration gives every LID in ascending order (same 
+ * as std::set<lid_t>).
+ */
+class lid_set_t
+{
+public:
+  /**
+   * @brief inclusive range of LIDs (first, last)
+   */
+  typedef std::pair<lid_t, lid_t> range_t;
+  typedef std::vector<range_t> ranges_t;
+  
+  /**
+   * @brief forward iterator over every LID
+   */
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef lid_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const lid_t * pointer;
+    typedef const lid_t & reference;
+    
+    const_iterator() : range(NULL), last(NULL), lid(0) {}
+    const_iterator(const range_t *range, const range_t *last, const lid_t lid) : range(range), last(last), lid(lid) {}
+    
+    reference operator*() const { return lid; }
+    pointer operator->() const { return &lid; }
+    
+    const_iterator &operator++()
+    {
+      if(lid != range->second)
+        ++lid;
+      else if(++range != last)
+        lid = range->first;
+      else
+        lid = 0;
+      return *this;
+    }
+    
+    const_iterator operator++(int) 
+    { 
+      const_iterator copy(*this); 
+      ++(*this); 
+      return copy; 
+    }
+    
+    bool operator==(const const_iterator &other) const { return range == other.range && lid == other.lid; }
+    bool operator!=(const const_iterator &other) const { return !(*this == other); }
+    
+  private:
+    /**
+     * @brief current range
+     */
+    const range_t *range;
+    
+    /**
+     * @brief end of ranges
+     */
+    const range_t *last;
+    
+    /**
+     * @brief current LID (0 at end)
+     */
+    lid_t lid;
+  };
+  typedef const_iterator iterator;
+  
+  /**
+   * @brief ctor
+   */
+  lid_set_t() : lid_count(0) {}
+  
+  /**
+   * @brief add LID to set
+   * @param lid LID to add
+   * @return iterator to LID and true if LID was not already in set
+   */
+  std::pair<const_iterator, bool> insert(const lid_t lid);
+  
+  /**
+   * @brief count LID in set
+   * @param lid LID to find
+   * @return 1 if LID is in set, otherwise 0
+   */
+  size_t count(const lid_t lid) const;
+  
+  const_iterator begin() const;
+  const_iterator end() const;
+  
+  /**
+   * @brief get number of LIDs in set
+   */
+  size_t size() const { return lid_count; }
+  
+  /**
+   * @brief check if set has no LIDs
+   */
+  bool empty() const { return ranges.empty(); }
+  
+  /**
+   * @brief get every range of LIDs (ascending)
+   */
+  const ranges_t &get_ranges() const { return ranges; }
+  
+  /**
+   * @brief clear every LID
+   */
+  void clear() { ranges.clear(); lid_count = 0; }
+  
+  bool operator==(const lid_set_t &other) const { return ranges == other.ranges; }
+  bool operator!=(const lid_set_t &other) const { return ranges != other.ranges; }
+  
+private:
+  /**
+   * @brief sorted disjoint non adjacent ranges
+   */
+  ranges_t ranges;
+  
+  /**
+   * @brief number of LIDs in every range
+   */
+  size_t lid_count;
+};
+
+/**
+ * @brief linear forwarding table (LFT)
+ * Holds the egress port of every unicast LID routed by a switch
+ * 
+ * Ports are stored in 4096 LID pages (same as 64 LFT blocks of 
+ * the switch) that are only allocated where the switch routes 
+ * LIDs, so extended LIDs do not need a table of every LID. 
+ * LIDs without a route hold the unreachable sentinel.
+ * 
+ * @see IBA 14.2.5.10 LinearForwardingTable
+ */
+class linear_forwarding_table_t
+{
+public:
+  typedef paged_table_t<port_num_t> ports_t;
+  
+  /**
+   * @brief port number of LIDs without a route
+   * IBA reserves port 255 as invalid
+   */
+  static const port_num_t unreachable;
+  
+  linear_forwarding_table_t() : ports(unreachable) {}
+  
+  /**
+   * @brief set egress port of LID
+   * @param lid destination lid
+   * @param port egress port
+   * @return true on success or false if lid is above MAX_LID_VALUE or page store is full
+   */
+  bool set(const lid_t lid, const port_num_t port);
+  
+  /**
+   * @brief set egress port of every LID of a page
+   * @param index page index (LID >> page_bits)
+   * @param page egress ports (unreachable if LID has no route)
+   * @return true on success or false if page store is full
+   */
+  bool set_page(const size_t index, const ports_t::page_t &page) { return ports.set_page(index, page); }
+  
+  /**
+   * @brief find egress port of LID
+   * @param lid destination lid
+   * @return egress port or unreachable
+   */
+  port_num_t find(const lid_t lid) const
+  {
+    return ports.find(lid);
+  }
+  
+  /**
+   * @brief get number of LIDs held (highest LID + 1)
+   */
+  size_t size() const { return ports.size(); }
+  
+  /**
+   * @brief check if table has no LIDs
+   */
+  bool empty() const { return ports.empty(); }
+  
+  /**
+   * @brief get egress port of every LID
+   */
+  const ports_t &get_ports() const { return ports; }
+  
+  /**
+   * @brief release pages without routes and trailing LIDs
+   */
+  void shrink();
+  
+  /**
+   * @brief share pages identical to pages of other tables
+   * @param pool pool of pages shared by every table
+   */
+  void share(ports_t::page_pool_t &pool) { ports.share(pool); }
+  
+  /**
+   * @brief allocate every page in store
+   * @param store memory mapped store (heap if NULL)
+   * @param moved pages already moved into store (shared by every table moved)
+   * @return true on success or false if store is full
+   */
+  bool set_store(const std::shared_ptr<page_store_t> &store, ports_t::moved_pages_t * const moved = NULL) 
+  { 
+    return ports.set_store(store, moved); 
+  }
+  
+  /**
+   * @brief clear every LID
+   */
+  void clear() { ports.clear(); }
+  
+  /**
+   * @brief compare routes of every LID
+   * @note LIDs past the end of either table are unreachable
+   */
+  bool operator==(const linear_forwarding_table_t &other) const;
+  
+private:
+  /**
+   * @brief egress port indexed by LID
+   */
+  ports_t ports;
+};
+
+/**
+ * @brief compiled next hop table
+ * Holds the neighbour reached through the egress port of every
+ * unicast LID routed by a switch, so a path walk needs a single
+ * array load per hop.
+ * 
+ * Every hop is packed into 32 bits: entity id of the neighbour
+ * (upper 24 bits) and ingress port of the neighbour (lower 8 bits).
+ * LIDs without a route (or routed to a dark port) hold the 
+ * unreachable sentinel.
+ * 
+ * @see fabric_t::build_next_hops()
+ */
+class next_hop_table_t
+{
+public:
+  typedef uint32_t hop_t;
+  typedef paged_table_t<hop_t> hops_t;
+  
+  /**
+   * @brief hop of LIDs without a neighbour
+   */
+  static const hop_t unreachable;
+  
+  /**
+   * @brief highest entity id that can be packed
+   */
+  static const uint32_t max_entity;
+  
+  next_hop_table_t() : hops(unreachable) {}
+  
+  /**
+   * @brief pack neighbour into hop
+   * @param entity neighbour entity id (<= max_entity)
+   * @param port neighbour ingress port
+   */
+  static hop_t pack(const uint32_t entity, const port_num_t port) { return entity << 8 | port; }
+  
+  /**
+   * @brief get neighbour entity id of hop
+   */
+  static uint32_t get_entity(const hop_t hop) { return hop >> 8; }
+  
+  /**
+   * @brief get neighbour ingress port of hop
+   */
+  static port_num_t get_port(const hop_t hop) { return static_cast<port_num_t>(hop & 0xFF); }
+  
+  /**
+   * @brief set neighbour of LID
+   * @param lid destination lid
+   * @param hop packed neighbour
+   * @return true on success or false if lid is above MAX_LID_VALUE
+   */
+  bool set(const lid_t lid, const hop_t hop);
+  
+  /**
+   * @brief find neighbour of LID
+   * @param lid destination lid
+   * @return packed neighbour or unreachable
+   */
+  hop_t find(const lid_t lid) const
+  {
+    return hops.find(lid);
+  }
+  
+  /**
+   * @brief get number of LIDs held (highest LID + 1)
+   */
+  size_t size() const { return hops.size(); }
+  
+  /**
+   * @brief check if table has no LIDs
+   */
+  bool empty() const { return hops.empty(); }
+  
+  /**
+   * @brief get neighbour of every LID
+   */
+  const hops_t &get_hops() const { return hops; }
+  
+  /**
+   * @brief clear every LID
+   */
+  void clear() { hops.clear(); }
+  
+private:
+  /**
+   * @brief packed neighbour indexed by LID
+   */
+  hops_t hops;
+};
+
+/**
+ * @brief adaptive routing table (AR)
+ * Holds the port group of every AR group of a switch and the 
+ * AR group assigned to every LID by every PLFT of the switch
+ * 
+ * Every port group is a port mask indexed directly by group 
+ * number (AR groups are numbered densely) and shared by every PLFT
+ */
+class adaptive_routing_table_t
+{
+public:
+  typedef port_masks_t::mask_word_t mask_word_t;
+  /**
+   * @brief AR group number
+   */
+  typedef uint16_t group_t;
+  /**
+   * @brief map of LID -> AR group
+   */
+  typedef std::map<lid_t, group_t> lid_groups_t;
+  /**
+   * @brief list of port numbers
+   */
+  typedef port_masks_t::ports_t ports_t;
+  
+  /**
+   * @brief ctor
+   */
+  adaptive_routing_table_t();
+  
+  /**
+   * @brief set switch radix
+   * @param radix highest port number of switch
+   * @note existing port masks are widened if needed
+   */
+  void set_radix(const port_num_t radix);
+  
+  /**
+   * @brief add port to AR group
+   * @param group AR group
+   * @param port port number in group
+   * @return true if port was not already in group
+   */
+  bool add_group_port(const group_t group, const port_num_t port);
+  
+  /**
+   * @brief assign AR group to LID
+   * @param lid destination lid
+   * @param group AR group
+   * @param plft PLFT of LID
+   */
+  void set_lid_group(const lid_t lid, const group_t group, const plft_num_t plft = 0);
+  
+  /**
+   * @brief find AR group of LID
+   * @param lid destination lid
+   * @param group set to AR group on success
+   * @param plft PLFT of LID
+   * @return true if LID is adaptively routed by PLFT
+   */
+  bool find_group(const lid_t lid, group_t &group, const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief find port mask of AR group
+   * @param group AR group
+   * @return ptr to get_mask_words() words or NULL if group is not known
+   */
+  const mask_word_t * find_mask(const group_t group) const;
+  
+  /**
+   * @brief get every port of AR group
+   * @param group AR group
+   * @param ports list to append port numbers to (ascending)
+   * @return true if group is known
+   */
+  bool get_group_ports(const group_t group, ports_t &ports) const;
+  
+  /**
+   * @brief get number of words per port mask
+   */
+  size_t get_mask_words() const { return masks.get_mask_words(); }
+  
+  /**
+   * @brief get number of AR groups (highest group + 1)
+   */
+  size_t get_group_count() const { return masks.size(); }
+  
+  /**
+   * @brief get every adaptively routed LID of PLFT
+   * @param plft PLFT of LIDs
+   */
+  const lid_groups_t &get_lids(const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief get number of PLFTs with adaptively routed LIDs (highest PLFT + 1)
+   */
+  size_t get_plft_count() const { return lids.size(); }
+  
+  /**
+   * @brief check if switch has any adaptive routes
+   */
+  bool empty() const;
+  
+  /**
+   * @brief clear every group and LID
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief LID -> AR group of every PLFT
+   */
+  std::vector<lid_groups_t> lids;
+  
+  /**
+   * @brief port mask of every AR group
+   */
+  port_masks_t masks;
+};
+
+/**
+ * @brief SL to VL mapping tables of an entity
+ * Every (ingress port, egress port) pair has a SL to VL table
+ * 
+ * Each table is 16 VL nibbles packed into a single 64bit word.
+ * Most switches use the same table on every port pair so the
+ * most common table is stored once for the entity and only
+ * the port pairs with a different table are stored
+ * 
+ * @see IBA 14.2.5.8 SLtoVLMappingTable
+ */
+class sl2vl_tables_t
+{
+public:
+  /**
+   * @brief packed SL to VL table
+   * VL of SL n is at bits 4n to 4n+3
+   */
+  typedef uint64_t sl2vl_t;
+  
+  /**
+   * @brief get VL from packed table
+   * @param table packed table
+   * @param sl service level
+   * @return VL
+   */
+  static vl_t get_vl(const sl2vl_t table, const sl_t sl)
+  {
+    return static_cast<vl_t>((table >> (4 * sl)) & 0xF);
+  }
+  
+  /**
+   * @brief set VL in packed table
+   * @param table packed table
+   * @param sl service level
+   * @param vl virtual lane
+   * @return updated table
+   */
+  static sl2vl_t set_vl(const sl2vl_t table, const sl_t sl, const vl_t vl)
+  {
+    const sl2vl_t shift = 4 * sl;
+    return (table & ~(static_cast<sl2vl_t>(0xF) << shift)) | (static_cast<sl2vl_t>(vl & 0xF) << shift);
+  }
+  
+  /**
+   * @brief ctor
+   */
+  sl2vl_tables_t();
+  
+  /**
+   * @brief set table of port pair
+   * @param in ingress port
+   * @param out egress port
+   * @param table packed table
+   * @note table is only staged until compact() is called
+   */
+  void set(const port_num_t in, const port_num_t out, const sl2vl_t table);
+  
+  /**
+   * @brief merge all staged tables
+   * picks the most common table as entity wide table (if not already set)
+   * and only keeps tables that differ from it
+   */
+  void compact();
+  
+  /**
+   * @brief find table of port pair
+   * @param in ingress port
+   * @param out egress port
+   * @param table set to packed table on success
+   * @return true if entity has any tables
+   * @warning compact() must be called after set()
+   */
+  bool find(const port_num_t in, const port_num_t out, sl2vl_t &table) const;
+  
+  /**
+   * @brief find VL of port pair
+   * @param in ingress port
+   * @param out egress port
+   * @param sl service level
+   * @param vl set to virtual lane on success
+   * @return true if entity has any tables
+   */
+  bool find_vl(const port_num_t in, const port_num_t out, const sl_t sl, vl_t &vl) const;
+  
+  /**
+   * @brief check if entity has any tables
+   */
+  bool empty() const { return !has_common && staged.empty(); }
+  
+  /**
+   * @brief get number of port pairs with their own table
+   */
+  size_t get_port_table_count() const { return tables.size(); }
+  
+  /**
+   * @brief clear all tables
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief (ingress port << 8 | egress port)
+   */
+  typedef uint16_t key_t;
+  typedef std::vector<std::pair<key_t, sl2vl_t> > tables_t;
+  
+  /**
+   * @brief true if common table is set
+   */
+  bool has_common;
+  
+  /**
+   * @brief entity wide table
+   */
+  sl2vl_t common;
+  
+  /**
+   * @brief port pair tables that differ from common (sorted by key)
+   */
+  tables_t tables;
+  
+  /**
+   * @brief tables given since last compact()
+   */
+  tables_t staged;
+};
+
+/**
+ * @brief ports of an entity indexed by port number
+ * Ports are held in an array indexed directly by port number (sized
+ * to the highest port number given) with a bitmap of used port numbers.
+ * Iteration gives (port number, port) pairs in ascending port number
+ * order (same as std::map<port_num_t, port_t*>).
+ */
+class port_array_t
+{
+public:
+  typedef std::pair<port_num_t, port_t *> value_type;
+  
+  /**
+   * @brief number of possible port numbers
+   */
+  static const unsigned int max_ports = 256;
+  
+  /**
+   * @brief forward iterator over every used port number
+   */
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef port_array_t::value_type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const value_type * pointer;
+    typedef const value_type & reference;
+    
+    const_iterator() : array(NULL), value(0, NULL) {}
+    const_iterator(const port_array_t *array, const unsigned int port) : array(array), value(0, NULL) { seek(port); }
+    
+    reference operator*() const { return value; }
+    pointer operator->() const { return &value; }
+    
+    const_iterator &operator++()
+    {
+      seek(static_cast<unsigned int>(value.first) + 1);
+      return *this;
+    }
+    
+    const_iterator operator++(int) 
+    { 
+      const_iterator copy(*this); 
+      ++(*this); 
+      return copy; 
+    }
+    
+    bool operator==(const const_iterator &other) const { return value == other.value; }
+    bool operator!=(const const_iterator &other) const { return !(*this == other); }
+    
+  private:
+    /**
+     * @brief move to first used port number >= port
+     */
+    void seek(const unsigned int port)
+    {
+      const unsigned int next = array->next(port);
+      value = next < max_ports ? value_type(next, array->slots[next]) : value_type(0, NULL);
+    }
+    
+    /**
+     * @brief array being walked
+     */
+    const port_array_t *array;
+    
+    /**
+     * @brief current port (NULL port at end)
+     */
+    value_type value;
+  };
+  typedef const_iterator iterator;
+  
+  /**
+   * @brief ctor
+   */
+  port_array_t() : port_count(0) { clear(); }
+  
+  /**
+   * @brief add port
+   * @param value (port number, port) to add (port may not be NULL)
+   * @return iterator to port number and true if port number was not used
+   */
+  std::pair<const_iterator, bool> insert(const value_type &value);
+  
+  /**
+   * @brief get port by port number
+   * @param port port number
+   * @return port or NULL if port number is not used
+   */
+  port_t * get(const port_num_t port) const { return test(port) ? slots[port] : NULL; }
+  
+  /**
+   * @brief find port number
+   * @param port port number
+   * @return iterator to port or end()
+   */
+  const_iterator find(const port_num_t port) const { return test(port) ? const_iterator(this, port) : end(); }
+  
+  /**
+   * @brief count port number
+   * @return 1 if port number is used, otherwise 0
+   */
+  size_t count(const port_num_t port) const { return test(port) ? 1 : 0; }
+  
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(); }
+  
+  /**
+   * @brief get number of ports
+   */
+  size_t size() const { return port_count; }
+  
+  /**
+   * @brief get highest used port number (0 if there are no ports)
+   */
+  port_num_t max_port() const { return slots.empty() ? 0 : static_cast<port_num_t>(slots.size() - 1); }
+  
+  /**
+   * @brief check if there are no ports
+   */
+  bool empty() const { return !port_count; }
+  
+  /**
+   * @brief remove every port (ports are not owned)
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief check if port number is used
+   */
+  bool test(const port_num_t port) const { return (used[port >> 6] >> (port & 63)) & 1; }
+  
+  /**
+   * @brief find first used port number >= port
+   * @return port number or max_ports if there is none
+   */
+  unsigned int next(unsigned int port) const;
+  
+  /**
+   * @brief port of every port number up to highest used port number
+   */
+  std::vector<port_t *> slots;
+  
+  /**
+   * @brief bitmap of used port numbers
+   */
+  uint64_t used[max_ports / 64];
+  
+  /**
+   * @brief number of used port numbers
+   */
+  size_t port_count;
+};
+
 /**
  * @brief Infiniband entity
  * This is generally denoted by a device (IB Chip) with a unique GUID
@@ -47,9 +962,21 @@ class fabric_t;
 class entity_t
 {
 public:
-  typedef std::map<port_num_t, port_t* const> portmap_t;
-  typedef std::map<port_num_t, std::set<lid_t> > routes_t;
-  typedef std::map<lid_t, port_num_t> unicast_forwarding_table_t;
+  typedef port_array_t portmap_t;
+  typedef std::map<port_num_t, lid_set_t> routes_t;
+  typedef linear_forwarding_table_t unicast_forwarding_table_t;
+  /**
+   * @brief forwarding table that may be shared by multiple PLFTs
+   */
+  typedef std::shared_ptr<unicast_forwarding_table_t> shared_uft_t;
+  /**
+   * @brief forwarding table of every PLFT
+   */
+  typedef std::vector<shared_uft_t> plfts_t;
+  /**
+   * @brief next hop table that may be shared by multiple PLFTs
+   */
+  typedef std::shared_ptr<const next_hop_table_t> shared_next_hops_t;
    
   /**
    * @brief Entity port type
@@ -67,9 +994,19 @@ public:
   portmap_t ports;
 
   /**
-   * @brief Map of lid to forwarded port
+   * @brief multicast forwarding table
    */
-  unicast_forwarding_table_t uft;  
+  multicast_forwarding_table_t mft;
+  
+  /**
+   * @brief adaptive routing table
+   */
+  adaptive_routing_table_t art;
+  
+  /**
+   * @brief SL to VL mapping tables
+   */
+  sl2vl_tables_t sl2vl;
 
  
   /**
@@ -81,9 +1018,15 @@ public:
   
   /**
    * @brief copy ctor
+   * copies every port ptr, route and table
    */
   entity_t(const entity_t &other);
   
+  /**
+   * @brief move ctor
+   */
+  entity_t(entity_t &&other) noexcept;
+  
   
   /**
    * @brief Add port to this entity
@@ -124,6 +1067,13 @@ public:
   */
   std::string label(const label_t type = LABEL_ENTITY_ONLY) const;
   
+  /**
+  * @brief get cached entity label (LABEL_ENTITY_ONLY)
+  * @return label (empty if entity has no ports)
+  * @note label is formatted when the first port changes instead of per call
+  */
+  const std::string & get_label() const { return entity_label; }
+  
   /**
    * @brief get entity lid
    */
@@ -144,78 +1094,451 @@ public:
    * @brief add route for entity
    * @param port source port
    * @param lid destination lid
+   * @param plft PLFT holding route
+   * @return true if route was added or false if route already exists or page store is full
+   * @note a LID routed to another port before is moved to the new port
+   */
+  bool add_route(const port_num_t port, const lid_t lid, const plft_num_t plft = 0);
+  
+  /**
+   * @brief replace routes of every LID in a forwarding table page
+   * @param index page index (LID >> page_bits)
+   * @param page egress port of every LID of page (unreachable if not routed)
+   * @param plft PLFT holding routes
+   * @return true on success or false if page store is full
+   * @note route map is rebuilt from the forwarding tables on next get_routes()
+   */
+  bool set_route_page(
+    const size_t index, 
+    const unicast_forwarding_table_t::ports_t::page_t &page, 
+    const plft_num_t plft = 0
+  );
+  
+  /**
+   * @brief add multicast route for entity
+   * @param mlid destination multicast lid
+   * @param port output port
+   * @return true on success
+   */
+  bool add_multicast_route(const lid_t mlid, const port_num_t port);
+  
+  /**
+   * @brief add port to adaptive routing group of entity
+   * @param group AR group
+   * @param port port number in group
+   * @return true if port was not already in group
+   */
+  bool add_adaptive_route(const adaptive_routing_table_t::group_t group, const port_num_t port);
+  
+  /**
+   * @brief get every possible egress port toward lid
+   * @param lid destination lid
+   * @param ports list to fill with port numbers (will always be cleared)
+   * @param plft PLFT of static route
+   * @return true if any egress port is known
+   * 
+   * gives every port of the AR group of lid if lid is adaptively routed
+   * otherwise gives the static port from the forwarding table
+   * @warning build_forwarding_table() must be called first
    */
-  bool add_route(const port_num_t port, const lid_t lid);
+  bool get_egress_ports(const lid_t lid, adaptive_routing_table_t::ports_t &ports, const plft_num_t plft = 0) const;
   
   /**
    * @brief get routes map
-   * @return routes map
+   * @param plft PLFT of routes
+   * @return routes map (empty if PLFT is not known)
+   */
+  const routes_t &get_routes(const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief get number of PLFTs with routes
+   * @return PLFT count
+   */
+  size_t get_plft_count() const { build_routes(); return routes.size(); }
+  
+  /**
+   * @brief get forwarding table
+   * @param plft PLFT of forwarding table
+   * @return forwarding table (empty if PLFT is not known)
+   * @note filled directly by add_route()
+   * @note replaces the former public uft member (get_uft() gives PLFT 0)
+   */
+  const unicast_forwarding_table_t &get_uft(const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief select PLFT of packets arriving on ingress port
+   * @param port ingress port (0 for packets sent by the switch)
+   * @param plft PLFT used for packets arriving on port
+   */
+  void set_port_plft(const port_num_t port, const plft_num_t plft);
+  
+  /**
+   * @brief get PLFT of packets arriving on ingress port
+   * @param port ingress port (0 for packets sent by the switch)
+   * @return PLFT (0 if never set)
+   */
+  plft_num_t get_port_plft(const port_num_t port) const;
+  
+  /**
+   * @brief get compiled next hop table
+   * @param plft PLFT of forwarding table
+   * @return next hop table (empty if not built or PLFT is not known)
+   * @note tables are dropped by add_route(), clear_routes() and add_port() (new cables)
+   */
+  const next_hop_table_t &get_next_hops(const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief compile forwarding tables into next hop tables
+   * @param fabric fabric holding entity
+   * @return true on success (no table is kept on failure)
+   * @note PLFTs sharing a forwarding table share the next hop table
+   * @see fabric_t::build_next_hops()
+   */
+  bool build_next_hops(const fabric_t &fabric);
+  
+  /**
+   * @brief drop every compiled next hop table
+   */
+  void clear_next_hops() { next_hops.clear(); }
+  
+  /**
+   * @brief get entity ports type
+   * @return type of ports on this entity
+   */
+  type_t get_type() const { return type; }
+  
+  /**
+   * @brief compact forwarding tables
+   * @return ture
+   * 
+   * PLFTs with identical tables share a single table
+   * (tables are copied again on the next add_route())
+   */
+  bool build_forwarding_table();
+  
+  /**
+   * @brief share identical forwarding table pages
+   * @param pool pool of pages shared with every other entity
+   * @return true
+   * 
+   * Pages are copied again on the next add_route() to the page
+   */
+  bool share_pages(unicast_forwarding_table_t::ports_t::page_pool_t &pool);
+  
+  /**
+   * @brief keep forwarding tables in memory mapped store
+   * @param store store of every forwarding table page (heap if NULL)
+   * @param moved pages already moved into store (keeps pages shared with other entities)
+   * @return true on success or false if store is full
+   * @note pages of existing tables are copied into store
+   */
+  bool set_page_store(
+    const std::shared_ptr<page_store_t> &store, 
+    unicast_forwarding_table_t::ports_t::moved_pages_t * const moved = NULL
+  );
+
+  /**
+   * @brief find next entity toward target
+   * @param fabric fabric holding entity
+   * @param target destination entity
+   * @param plft PLFT to forward with
+   * @return next entity
+   */
+  entity_t& forward(fabric_t& fabric, const entity_t& target, const plft_num_t plft = 0);
+
+
+private:
+  /**
+   * @brief get first port assigned to this entity
+   * @return port ptr or NULL
+   * 
+   * First port is used by multiple functions to
+   * determine the entity properties since they
+   * are shared by all ports
+   */
+  port_t * get_first_port();
+  port_t const * get_first_port() const;
+  
+  /**
+   * @brief rebuild routes from forwarding tables if they are stale
+   */
+  void build_routes() const;
+  
+  /**
+   * @brief Entity unicast routes port map of every PLFT
+   * each port can be assigned as route to different entities
+   */
+  mutable std::vector<routes_t> routes;
+  
+  /**
+   * @brief routes disagree with the forwarding tables (set_route_page() or a re-routed LID)
+   */
+  mutable bool routes_stale;
+  
+  /**
+   * @brief forwarding table of every PLFT
+   */
+  plfts_t ufts;
+  
+  /**
+   * @brief compiled next hop table of every PLFT
+   */
+  std::vector<shared_next_hops_t> next_hops;
+  
+  /**
+   * @brief PLFT of every ingress port (ports past the end use PLFT 0)
+   */
+  std::vector<plft_num_t> port_plfts;
+  
+  /**
+   * @brief store of forwarding table pages (NULL for heap)
+   */
+  std::shared_ptr<page_store_t> page_store;
+  
+  /**
+   * @brief types of ports on this entity
+   */
+  type_t type;
+  
+  /**
+   * @brief cached LABEL_ENTITY_ONLY label of first port
+   */
+  std::string entity_label;
+};
+
+/**
+ * @brief multicast delivery tree
+ * @see fabric_t::expand_multicast_tree()
+ */
+struct multicast_tree_t
+{
+  /**
+   * @brief link used by tree (egress port -> ingress port)
+   */
+  typedef std::pair<const port_t *, const port_t *> link_t;
+  
+  /**
+   * @brief every link used by tree in walk order
+   */
+  std::vector<link_t> links;
+  
+  /**
+   * @brief every switch forwarding MLID in walk order
+   */
+  std::vector<const entity_t *> switches;
+  
+  /**
+   * @brief every entity receiving MLID
+   * this is every HCA reached and every switch with port 0 in port mask
+   */
+  std::vector<const entity_t *> members;
+  
+  /**
+   * @brief true if a switch was reached more than once
+   */
+  bool loop;
+  
+  /**
+   * @brief clear tree
+   */
+  void clear();
+};
+
+/**
+ * @brief every path a unicast packet may take with adaptive routing
+ * @see fabric_t::expand_adaptive_routes()
+ */
+struct adaptive_route_t
+{
+  /**
+   * @brief switch on path and every egress port it may use
+   */
+  struct hop_t
+  {
+    /**
+     * @brief switch forwarding packet
+     */
+    const entity_t *entity;
+    
+    /**
+     * @brief hops from source entity
+     */
+    unsigned int distance;
+    
+    /**
+     * @brief every port switch may forward packet out of
+     */
+    std::vector<const port_t *> egress;
+  };
+  
+  /**
+   * @brief every switch on any path in walk order
+   */
+  std::vector<hop_t> hops;
+  
+  /**
+   * @brief true if destination is reached by any path
+   */
+  bool reached;
+  
+  /**
+   * @brief true if a switch was reached again from a switch at the same or greater distance
+   */
+  bool loop;
+  
+  /**
+   * @brief clear route
+   */
+  void clear();
+};
+
+/**
+ * @brief IB Fabric composed of entities
+ */
+class fabric_t
+{
+protected:
+  /**
+   * @brief cluster lmc value
+   * this is usually 0
+   * number of lids per port = 2^lmc
+   * each extra lmc lid is sequencial
+   */
+  lmc_t lmc;
+  
+  /**
+   * @brief true if port lids and lmcs are exact
+   * set once any port lid has been given by set_port_lid()
+   */
+  bool port_lids_exact;
+  
+public:
+  typedef port_t::portmap_guidport_t portmap_guidport_t;
+  /**
+   * @brief every entity indexed by entity id
+   * ids are given in creation order and never change
+   */
+  typedef std::vector<entity_t> entities_t;
+  /**
+   * @brief owner of a lid
+   */
+  struct lid_owner_t {
+    /**
+     * @brief owner entity id (no_entity if lid is not used)
+     */
+    uint32_t entity;
+    /**
+     * @brief owner port number (0 for switches)
+     */
+    port_num_t port;
+    
+    bool operator==(const lid_owner_t &other) const 
+    {
+      return entity == other.entity && port == other.port;
+    }
+  };
+  /**
+   * @brief lid owner indexed by lid (paged)
    */
-  const routes_t &get_routes() const { return routes; }
+  typedef paged_table_t<lid_owner_t> lidindex_t;
   
   /**
-   * @brief get entity ports type
-   * @return type of ports on this entity
+   * @brief entity id of unknown entities and unused lids
+   */
+  static const uint32_t no_entity;
+  
+  /**
+   * @brief owner of unused lids
+   */
+  static const lid_owner_t unused_lid;
+  /**
+   * @brief dense port index (sorted same as portmap)
+   */
+  typedef std::vector<port_t *> portindex_t;
+  /**
+   * @brief compact copy of the port fields walked by lid map builds and reachability
+   * records are stored contiguously in port index order while port_t keeps every field
+   * @see get_port_records()
+   */
+  struct port_record_t {
+    /**
+     * @brief port guid
+     */
+    guid_t guid;
+    /**
+     * @brief owner entity id
+     */
+    uint32_t entity;
+    /**
+     * @brief port index of connected port (no_port if not cabled)
+     */
+    uint32_t remote;
+    /**
+     * @brief port base lid
+     */
+    uint32_t lid;
+    /**
+     * @brief port number
+     */
+    port_num_t port;
+    /**
+     * @brief port type (port_type::type_t)
+     */
+    uint8_t type;
+    /**
+     * @brief port lmc
+     */
+    lmc_t lmc;
+  };
+  /**
+   * @brief port record of every port in port index
    */
-  type_t get_type() const { return type; }
+  typedef std::vector<port_record_t> port_records_t;
   
   /**
-   * @brief builds port->lid map (forwarding database)
-   * @return ture
+   * @brief port index of unknown ports
    */
-  bool build_forwarding_table();
-
-  entity_t& forward(fabric_t& fabric, const entity_t& target);
-
-
-private:
+  static const uint32_t no_port;
   /**
-   * @brief get first port assigned to this entity
-   * @return port ptr or NULL
-   * 
-   * First port is used by multiple functions to
-   * determine the entity properties since they
-   * are shared by all ports
+   * @brief bitmap with one bit per port in port index
    */
-  port_t * get_first_port();
-  port_t const * get_first_port() const;
-  
+  typedef std::vector<uint64_t> port_bitmap_t;
   /**
-   * @brief Entity unicast routes port map
-   * each port can be assigned as route to different entities
+   * @brief partition membership
    */
-  routes_t routes;
-  
+  struct partition_t {
+    /**
+     * @brief every member port (full and limited)
+     */
+    port_bitmap_t members;
+    /**
+     * @brief only full member ports
+     */
+    port_bitmap_t full_members;
+  };
   /**
-   * @brief types of ports on this entity
+   * @brief map of partition (pkey without membership bit) -> membership
    */
-  type_t type;
-};
-
-/**
- * @brief IB Fabric composed of entities
- */
-class fabric_t
-{
-protected:
+  typedef std::map<pkey_t, partition_t> partitions_t;
   /**
-   * @brief cluster lmc value
-   * this is usually 0
-   * number of lids per port = 2^lmc
-   * each extra lmc lid is sequencial
+   * @brief port reachability matrix
+   * one port bitmap of source ports for every destination port in port index
    */
-  lmc_t lmc;
-  
-public:
-  typedef port_t::portmap_guidport_t portmap_guidport_t;
-  typedef std::map<guid_t, entity_t> entities_t;
-  typedef std::map<lid_t, entity_t*> entitiesmap_lid_t;
+  typedef std::vector<port_bitmap_t> reachability_t;
  
   /**
    * @brief get lmc value
    */
   lmc_t get_lmc() const { return lmc; };
   
+  /**
+   * @brief set lmc value
+   * @param value lmc of every HCA port
+   * @return false if value is above MAX_LMC_VALUE
+   * @note used by build_lid_map() unless it determines lmc (or lids are exact)
+   */
+  bool set_lmc(const lmc_t value);
+  
   /**
    * @brief Add cable to fabric
    * @param port1 ptr to port1 (will take ownership)
@@ -237,20 +1560,76 @@ public:
   /**
    * @brief Add all cables from portmap to fabric
    * @param portmap portmap containing cables to add. 
-   *    will take ownership of all ports. 
+   *    will take ownership of all ports (allocated with new or by get_port_arena()). 
    *    will clear _portmap of all values
    * @return true on success
    */
   bool add_cables(portmap_guidport_t &_portmap); 
   
+  /**
+   * @brief get arena owning every port of fabric
+   * @return port arena
+   * @note parsers allocate ports here before calling add_cables()
+   */
+  port_arena_t & get_port_arena() { return arena; }
+  
   /**
    * @brief build lid map
    * @brief determine_lmc Determine LMC based on lids
-   * @return true on success
+   * @return true on success or false if two entities share a lid
    * @warning will always clear lidmap first
+   * 
+   * gives every lid (including
+   * lmc lids) of every entity its owning entity and port
    */
   bool build_lid_map(bool determine_lmc = false);  
   
+  /**
+   * @brief find entity owning lid
+   * @param lid lid to find
+   * @return entity ptr or NULL if lid is not known
+   * @warning build_lid_map() must be called first
+   */
+  entity_t * find_lid(const lid_t lid)
+  {
+    const uint32_t index = lidmap.find(lid).entity;
+    return index == no_entity ? NULL : &entities[index];
+  }
+  
+  /**
+   * @brief find entity and port owning lid
+   * @param lid lid to find
+   * @param entity set to entity ptr on success
+   * @param port set to port number on success (0 for switches)
+   * @return true if lid is known
+   * @warning build_lid_map() must be called first
+   */
+  bool find_lid(const lid_t lid, const entity_t *&entity, port_num_t &port) const;
+  
+  /**
+   * @brief get lid owner of every lid
+   */
+  const lidindex_t & get_lid_index() const { return lidmap; }
+  
+  /**
+   * @brief set exact lid and lmc of port
+   * @param guid port guid
+   * @param port port number
+   * @param lid base lid of port
+   * @param lmc lmc value of port
+   * @return true on success
+   * @warning port must already be known to fabric
+   * @note once called, build_lid_map() uses every port lid+lmc as given
+   *  instead of the entity lid and will not attempt to determine lmc
+   */
+  bool set_port_lid(const guid_t guid, const port_num_t port, const lid_t lid, const lmc_t lmc);
+  
+  /**
+   * @brief check if port lids are exact
+   * @return true if port lids have been given by set_port_lid()
+   */
+  bool has_exact_port_lids() const { return port_lids_exact; }
+  
   /**
    * @brief clear routes on every entity
    * @return true on success
@@ -269,9 +1648,120 @@ public:
    * @param guid entity source
    * @param port entity source port
    * @param lid destination lid
+   * @param plft PLFT holding route
+   * @return true on success
+   */
+  bool add_route(const guid_t guid, const port_num_t port, const lid_t lid, const plft_num_t plft = 0);
+  
+  /**
+   * @brief add multicast route
+   * @param guid entity source
+   * @param mlid destination multicast lid
+   * @param port entity output port
+   * @return true on success
+   */
+  bool add_multicast_route(const guid_t guid, const lid_t mlid, const port_num_t port);
+  
+  /**
+   * @brief clear multicast routes on every entity
+   * @return true on success
+   */
+  bool clear_multicast_routes();
+  
+  /**
+   * @brief add port to adaptive routing group
+   * @param guid entity source
+   * @param group AR group
+   * @param port entity output port
+   * @return true on success
+   */
+  bool add_adaptive_route(const guid_t guid, const adaptive_routing_table_t::group_t group, const port_num_t port);
+  
+  /**
+   * @brief assign adaptive routing group to destination lid
+   * @param guid entity source
+   * @param lid destination lid
+   * @param group AR group
+   * @param plft PLFT of lid
+   * @return true on success
+   */
+  bool set_adaptive_route_group(
+    const guid_t guid, const lid_t lid, 
+    const adaptive_routing_table_t::group_t group, const plft_num_t plft = 0
+  );
+  
+  /**
+   * @brief select PLFT of packets arriving on switch ingress port
+   * @param guid entity source
+   * @param port ingress port (0 for packets sent by the switch)
+   * @param plft PLFT used for packets arriving on port
+   * @return true on success
+   */
+  bool set_port_plft(const guid_t guid, const port_num_t port, const plft_num_t plft);
+  
+  /**
+   * @brief clear adaptive routes on every entity
+   * @return true on success
+   */
+  bool clear_adaptive_routes();
+  
+  /**
+   * @brief set SL to VL table of port pair
+   * @param guid entity guid
+   * @param in ingress port
+   * @param out egress port
+   * @param table packed SL to VL table
+   * @return true on success
+   * @warning call compact_sl2vl() after all tables of entity are given
+   */
+  bool add_sl2vl(const guid_t guid, const port_num_t in, const port_num_t out, const sl2vl_tables_t::sl2vl_t table);
+  
+  /**
+   * @brief compact SL to VL tables of entity
+   * @param guid entity guid
+   * @return true on success
+   */
+  bool compact_sl2vl(const guid_t guid);
+  
+  /**
+   * @brief expand MLID into delivery tree
+   * @param mlid multicast lid
+   * @param source entity sending to MLID (HCA or switch)
+   * @param tree tree to fill (will always be cleared)
+   * @return true on success
+   * 
+   * walks the MFT of every switch from source. packets
+   * are never forwarded back out of the ingress port.
+   * HCAs are assumed to send out of their first port
+   * (see find_hca_leaf()).
+   */
+  bool expand_multicast_tree(const lid_t mlid, const entity_t &source, multicast_tree_t &tree) const;
+  
+  /**
+   * @brief expand every path between two entities with adaptive routing
+   * @param start source entity (HCA or switch)
+   * @param end destination entity (HCA or switch)
+   * @param route route to fill (will always be cleared)
+   * @param plft PLFT of static routes
    * @return true on success
+   * @warning build_forwarding_table() must be called first
+   * 
+   * walks every egress port given by entity_t::get_egress_ports() 
+   * from start toward the lid of end. HCAs are assumed to send out 
+   * of their first port (see find_hca_leaf()).
+   */
+  bool expand_adaptive_routes(const entity_t &start, const entity_t &end, adaptive_route_t &route, const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief find entity an HCA sends to
+   * @param hca HCA entity
+   * @param port set to HCA port (if not NULL)
+   * @return entity cabled to HCA or NULL if HCA is not cabled
+   * 
+   * ibdiagnet does not give routes for HCAs so every HCA is
+   * assumed to send out of its first port
    */
-  bool add_route(const guid_t guid, const port_num_t port, const lid_t lid);
+  const entity_t * find_hca_leaf(const entity_t &hca, const port_t ** const port = NULL) const;
   
   /**
    * @brief Print Fabric layout
@@ -279,6 +1769,42 @@ public:
    */
   void print_fabric(std::ostream &ost) const;
   
+  /**
+   * @brief save fabric in binary snapshot format
+   * @param os binary output stream
+   * @return true on success
+   * 
+   * Holds ports, cables, names, entities (in entity id order), lmc,
+   * lid map and unicast routes of every PLFT. Multicast, adaptive
+   * routing, ingress port PLFTs, SL2VL, partitions and unrecognized 
+   * speed or width strings (saved as unknown) are not saved.
+   * 
+   * @see load()
+   */
+  bool save(std::ostream &os) const;
+  
+  /**
+   * @brief load fabric saved by save()
+   * @param is binary input stream
+   * @return true on success
+   * @warning fabric must be empty (and is left empty on failure)
+   * @note snapshots of other versions or byte order, snapshots
+   *    failing the checksum and snapshots holding sizes, types,
+   *    PLFTs or pages out of range, duplicate ports or trailing
+   *    data are rejected
+   * 
+   * Whole snapshot is read at once and every array is copied 
+   * in bulk, so loading needs no text parsing. Forwarding table
+   * pages are installed whole and the route map of an entity is
+   * only rebuilt from its pages when first used.
+   */
+  bool load(std::istream &is);
+  
+  /**
+   * @brief binary snapshot format version
+   */
+  static const uint32_t snapshot_version;
+  
   /**
    * @brief Find entity by guid
    * @param guid guid to search for
@@ -289,16 +1815,36 @@ public:
   entities_t::iterator find_entity(guid_t guid, entity_t::type_t type = port_type::UNKNOWN, bool create = false);
   
   /**
-   * @brief get map of all entities on fabric
-   * @return entities map reference
+   * @brief Find entity by guid using hash index
+   * @param guid guid to search for
+   * @return entity ptr or NULL if not known
+   * @warning ptr is only valid until the next entity is created
+   */
+  entity_t * get_entity(const guid_t guid) { return entityhash.find(guid); }
+  const entity_t * get_entity(const guid_t guid) const { return entityhash.find(guid); }
+  
+  /**
+   * @brief Find entity id by guid using hash index
+   * @param guid guid to search for
+   * @return entity id (index in get_entities()) or no_entity if not known
+   */
+  uint32_t get_entity_id(const guid_t guid) const
+  {
+    const entity_t * const entity = entityhash.find(guid);
+    return entity ? static_cast<uint32_t>(entity - &entities.front()) : no_entity;
+  }
+  
+  /**
+   * @brief get every entity on fabric
+   * @return entities indexed by entity id
    */
-  const entities_t & get_entities() { return entities; }
+  const entities_t & get_entities() const { return entities; }
   
   /**
    * @brief get port map of all ports on fabric
    * @return port map reference
    */
-  const portmap_guidport_t & get_portmap() { return portmap; }
+  const portmap_guidport_t & get_portmap() const { return portmap; }
 
   /**
    * @brief get a port structure by GUID
@@ -320,18 +1866,175 @@ public:
    * @return ture
    */
   bool build_forwarding_table(); 
+  
+  /**
+   * @brief keep every forwarding table in a memory mapped file
+   * @param directory directory to create backing file in (file is unlinked right away)
+   * @return true on success
+   * 
+   * Forwarding table pages of every entity (existing and added
+   * later by add_route()) are allocated in the file and the page 
+   * cache keeps the pages in use resident. Lookups are unchanged.
+   */
+  bool map_forwarding_tables(const std::string &directory);
+  
+  /**
+   * @brief keep every forwarding table in page store
+   * @param store store of every forwarding table page (heap if NULL)
+   * @return true on success or false if store is full
+   * @see map_forwarding_tables()
+   */
+  bool set_page_store(const std::shared_ptr<page_store_t> &store);
+  
+  /**
+   * @brief get store of forwarding table pages (NULL for heap)
+   */
+  const std::shared_ptr<page_store_t> & get_page_store() const { return page_store; }
 
   /**
    * @brief count the distance between two entities
+   * @param start source entity
+   * @param end destination entity
    * @return hops
+   * 
+   * every switch forwards with the PLFT of the port the packet 
+   * arrived on (see entity_t::set_port_plft()). HCAs are assumed
+   * to send out of their first port (see find_hca_leaf()).
    */
   unsigned int count_hops(const entity_t& start, const entity_t& end); 
   
+  /**
+   * @brief compile every forwarding table into next hop tables
+   * @return true on success (no entity keeps tables on failure)
+   * @note call once after routes are loaded (and after build_forwarding_table())
+   * @note tables of both entities of a new cable are dropped
+   * 
+   * forward() and count_hops() use next hop tables when built
+   */
+  bool build_next_hops();
+  
+  /**
+   * @brief drop compiled next hop tables of every entity
+   */
+  void clear_next_hops();
+  
+  /**
+   * @brief get entity by entity id
+   * @param id entity id
+   * @return entity
+   */
+  entity_t & get_entity_by_id(const uint32_t id) { return entities[id]; }
+  const entity_t & get_entity_by_id(const uint32_t id) const { return entities[id]; }
+  
+  /**
+   * @brief renumber every entity id
+   * @param order old entity id of every new entity id (permutation)
+   * @return true on success
+   * 
+   * Entities are moved into the new order and every entity id held 
+   * by the fabric (lid map, port records, next hop tables) is 
+   * rewritten, so lookups by GUID and LID keep working. Use a 
+   * topology order (fabric_graph_t::cuthill_mckee()) to give 
+   * neighbouring entities close ids for all-pairs walks.
+   * 
+   * @warning every entity ptr and id held outside the fabric 
+   *  (including graph views) is invalid afterwards
+   */
+  bool renumber_entities(const std::vector<uint32_t> &order);
+  
+  /**
+   * @brief build dense port index
+   * @return true on success
+   * @note partition membership is carried over to the new index
+   */
+  bool build_port_index();
+  
+  /**
+   * @brief get dense port index
+   * @return port index (bit n of every port bitmap is port index[n])
+   */
+  const portindex_t & get_port_index() const { return portindex; }
+  
+  /**
+   * @brief copy port fields into port records
+   * @return true on success or false if a port lid is above MAX_LID_VALUE
+   * @note build_port_index() and build_lid_map() call this
+   * @note records are rebuilt when first used after set_port_lid() or 
+   *  add_cable() so only call after changing ports directly
+   */
+  bool update_port_records() const;
+  
+  /**
+   * @brief get port records
+   * @return port record of every port (same order as port index)
+   * @note stale records are rebuilt first (empty on failure)
+   */
+  const port_records_t & get_port_records() const;
+  
+  /**
+   * @brief find port in dense port index
+   * @param guid port guid
+   * @param port port number
+   * @param index set to port index on success
+   * @return true if found
+   */
+  bool find_port_index(const guid_t guid, const port_num_t port, size_t &index) const;
+  
+  /**
+   * @brief add pkey to port
+   * @param guid port guid
+   * @param port port number
+   * @param pkey pkey (including membership bit)
+   * @return true on success
+   * @note builds port index if needed
+   */
+  bool add_pkey(const guid_t guid, const port_num_t port, const pkey_t pkey);
+  
+  /**
+   * @brief clear every partition
+   * @return true on success
+   */
+  bool clear_partitions();
+  
+  /**
+   * @brief get every partition
+   * @return partitions map
+   */
+  const partitions_t & get_partitions() const { return partitions; }
+  
+  /**
+   * @brief build reachability of every port pair inside partition
+   * @param pkey partition (membership bit is ignored)
+   * @param matrix filled with source port bitmap for every destination port
+   * @param plft PLFT every switch forwards with
+   * @return true on success
+   * @warning build_forwarding_table() must be called first
+   * 
+   * source can reach destination when the unicast forwarding tables deliver 
+   * packets from source to destination lid, both ports are members of the 
+   * partition and at least one of them is a full member.
+   * only HCA ports are given as sources and destinations.
+   */
+  bool build_partition_reachability(const pkey_t pkey, reachability_t &matrix, const plft_num_t plft = 0) const;
+  
   /**
    * @brief ctor
    */
   fabric_t();
   
+  /**
+   * @brief move ctor
+   * @param other fabric to move (left empty)
+   * @note entity and port ptrs stay valid
+   */
+  fabric_t(fabric_t &&other);
+  
+  /**
+   * @brief move assignment
+   * @param other fabric to move (left empty)
+   */
+  fabric_t &operator=(fabric_t &&other);
+  
   /**
    * @brief dtor
    * safely frees every port and entity
@@ -341,19 +2044,107 @@ public:
 protected:
   
   /**
-   * @brief every entity on this fabric
+   * @brief build lid map from exact port lids
+   * @return true on success
+   * 
+   * every lid of every port is known so this is a
+   * single walk of all ports without guessing lmc
+   */
+  bool build_exact_lid_map();
+
+  /**
+   * @brief fill empty fabric from binary snapshot
+   * @param is binary input stream
+   * @return true on success (fabric is left partially filled on failure)
+   * @see load()
+   */
+  bool read_snapshot(std::istream &is);
+
+  /**
+   * @brief release port that was not added to fabric
+   * @param port port allocated with new or by arena
+   */
+  void release_port(port_t * const port);
+  
+  /**
+   * @brief give lid to owner
+   * @param lid lid to give
+   * @param entity owner entity id
+   * @param port owner port number
+   * @return false if lid was already given to another entity or lid is above MAX_LID_VALUE
+   * @note lid is always given to new owner (unless above MAX_LID_VALUE)
+   */
+  bool set_lid_owner(const lid_t lid, const uint32_t entity, const port_num_t port);
+  
+  /**
+   * @brief rebuild port records if stale
+   * @return true on success
+   */
+  bool refresh_port_records() const;
+  
+  /**
+   * @brief owner of every port on this fabric
+   * (destroyed after everything pointing to ports)
+   */
+  port_arena_t arena;
+  
+  /**
+   * @brief rebuild entity hash index
+   * every entity moves when entities grows
+   */
+  void index_entities();
+  
+  /**
+   * @brief every entity on this fabric (indexed by entity id)
+   * @note use entityhash for lookups
    */
   entities_t entities;
   
   /**
    * @brief Guid,port map holding all ports on this fabric
+   * @note ordered for reports, use porthash for lookups
    */
   portmap_guidport_t portmap;
+  
+  /**
+   * @brief hash index of every entity by guid
+   */
+  guid_port_hash_t<entity_t> entityhash;
+  
+  /**
+   * @brief hash index of every port by guid and port number
+   */
+  guid_port_hash_t<port_t> porthash;
  
   /**
-   * @brief lid -> entity map 
+   * @brief lid -> owner map (indexed by lid)
+   */
+  lidindex_t lidmap;
+  
+  /**
+   * @brief dense port index
+   */
+  portindex_t portindex;
+  
+  /**
+   * @brief port records (same order as port index)
+   */
+  mutable port_records_t portrecords;
+  
+  /**
+   * @brief true if ports changed since port records were built
+   */
+  mutable bool portrecords_stale;
+  
+  /**
+   * @brief partition membership of ports in port index
+   */
+  partitions_t partitions;
+  
+  /**
+   * @brief store of forwarding table pages (NULL for heap)
    */
-  entitiesmap_lid_t lidmap;
+  std::shared_ptr<page_store_t> page_store;
 
 
   
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ib_graph.h"
+#include<cassert>
+#include<algorithm>
+
+namespace infiniband {
+  
+bool fabric_graph_t::build(const fabric_t &fabric, const variant_t type)
+{
+  clear();
+  variant = type;
+  
+  const fabric_t::entities_t &entities = fabric.get_entities();
+  
+  offsets.reserve(entities.size() + 1);
+  edges.reserve(fabric.get_portmap().size());
+  
+  for(size_t id = 0; id < entities.size(); ++id)
+  {
+    const entity_t &entity = entities[id];
+    offsets.push_back(static_cast<uint32_t>(edges.size()));
+    
+    if(variant == GRAPH_SWITCHES_ONLY && entity.get_type() != port_type::TCA)
+      continue;
+    
+    ///ports are walked in port number order
+    for(
+      entity_t::portmap_t::const_iterator
+        itr = entity.ports.begin(),
+        eitr = entity.ports.end();
+      itr != eitr;
+      ++itr
+    )
+    {
+      const port_t * const port = itr->second;
+      const port_t * const remote = port->connection;
+      
+      ///dark port
+      if(!remote)
+        continue;
+      
+      if(variant == GRAPH_SWITCHES_ONLY && remote->type != port_type::TCA)
+        continue;
+      
+      const uint32_t neighbour = fabric.get_entity_id(remote->guid);
+      assert(neighbour != fabric_t::no_entity);
+      if(neighbour == fabric_t::no_entity)
+      {
+        clear();
+        return false;
+      }
+      
+      edge_t edge;
+      edge.entity = neighbour;
+      edge.port = port->port;
+      edge.remote_port = remote->port;
+      edge.speed = static_cast<uint8_t>(port_speed::is_known(port->speed) ? port->speed : port_speed::UNKNOWN);
+      edge.width = static_cast<uint8_t>(port_width::is_known(port->width) ? port->width : port_width::UNKNOWN);
+      edges.push_back(edge);
+    }
+  }
+  
+  offsets.push_back(static_cast<uint32_t>(edges.size()));
+  
+  return true;
+}
+
+void fabric_graph_t::cuthill_mckee(order_t &order) const
+{
+  const size_t count = get_vertex_count();
+  
+  order.clear();
+  order.reserve(count);
+  
+  std::vector<bool> visited(count, false);
+  
+  ///vertices are sorted as (degree, id) pairs
+  typedef std::vector<std::pair<size_t, uint32_t> > ranked_t;
+  
+  ///start of every component: lowest degree (then lowest id)
+  ranked_t starts(count);
+  for(size_t i = 0; i < count; ++i)
+    starts[i] = std::make_pair(degree(i), static_cast<uint32_t>(i));
+  std::sort(starts.begin(), starts.end());
+  
+  ranked_t neighbours;
+  for(size_t s = 0; s < count; ++s)
+  {
+    const uint32_t start = starts[s].second;
+    if(visited[start])
+      continue;
+    
+    visited[start] = true;
+    order.push_back(start);
+    
+    ///order doubles as the BFS queue
+    for(size_t head = order.size() - 1; head < order.size(); ++head)
+    {
+      const uint32_t vertex = order[head];
+      
+      neighbours.clear();
+      for(const edge_t *edge = begin(vertex), *eedge = end(vertex); edge != eedge; ++edge)
+        if(!visited[edge->entity])
+        {
+          visited[edge->entity] = true;
+          neighbours.push_back(std::make_pair(degree(edge->entity), edge->entity));
+        }
+      
+      std::sort(neighbours.begin(), neighbours.end());
+      for(ranked_t::const_iterator itr = neighbours.begin(); itr != neighbours.end(); ++itr)
+      {
+        order.push_back(itr->second);
+        
+        ///keep HCAs (single cable) right after their leaf switch
+        for(const edge_t *edge = begin(itr->second), *eedge = end(itr->second); edge != eedge; ++edge)
+          if(!visited[edge->entity] && degree(edge->entity) == 1)
+          {
+            visited[edge->entity] = true;
+            order.push_back(edge->entity);
+          }
+      }
+    }
+  }
+  
+  assert(order.size() == count);
+}
+
+void fabric_graph_t::clear()
+{
+  offsets.clear();
+  edges.clear();
+  variant = GRAPH_FULL;
+}
+
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "ib_fabric.h"
+#include<vector>
+#if __cplusplus <= 199711L
+#include<stdint.h>
+#else
+#include<cstdint>
+#endif ///cplusplus
+
+#ifndef IB_GRAPH_H
+#define IB_GRAPH_H
+
+namespace infiniband {
+
+/**
+ * @brief compressed sparse row (CSR) adjacency view of a fabric
+ * Every cable of every entity is packed into a single edge array
+ * sorted by entity id and then local port number. The edges of 
+ * entity id n are edges[offsets[n]] to edges[offsets[n + 1]].
+ * 
+ * Vertex ids are always the fabric entity ids so results of walks
+ * can be used directly with fabric_t::get_entities().
+ * 
+ * @warning view is not updated when the fabric changes (build it again)
+ */
+class fabric_graph_t {
+public:
+  /**
+   * @brief graph variants
+   */
+  enum variant_t {
+    /**
+     * @brief every cable
+     */
+    GRAPH_FULL = 0,
+    /**
+     * @brief only cables between two switches
+     * HCAs are still vertices but have no edges
+     */
+    GRAPH_SWITCHES_ONLY
+  };
+  
+  /**
+   * @brief packed edge (cable from a local port)
+   */
+  struct edge_t {
+    /**
+     * @brief neighbour entity id
+     */
+    uint32_t entity;
+    /**
+     * @brief local port number
+     */
+    port_num_t port;
+    /**
+     * @brief neighbour port number
+     */
+    port_num_t remote_port;
+    /**
+     * @brief link speed (port_speed::speed_t, UNKNOWN if unrecognized)
+     */
+    uint8_t speed;
+    /**
+     * @brief link width (port_width::width_t, UNKNOWN if unrecognized)
+     */
+    uint8_t width;
+  };
+  typedef std::vector<uint32_t> offsets_t;
+  typedef std::vector<edge_t> edges_t;
+  /**
+   * @brief entity order (old entity id of every new entity id)
+   */
+  typedef std::vector<uint32_t> order_t;
+  
+  /**
+   * @brief ctor
+   * graph starts empty
+   */
+  fabric_graph_t() : variant(GRAPH_FULL) {}
+  
+  /**
+   * @brief build graph from fabric
+   * @param fabric fabric to build from
+   * @param type graph variant
+   * @return true on success
+   * @warning always clears graph first
+   */
+  bool build(const fabric_t &fabric, const variant_t type = GRAPH_FULL);
+  
+  /**
+   * @brief clear graph
+   */
+  void clear();
+  
+  /**
+   * @brief get graph variant
+   */
+  variant_t get_variant() const { return variant; }
+  
+  /**
+   * @brief get number of vertices (same as number of entities)
+   */
+  size_t get_vertex_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  
+  /**
+   * @brief get number of edges
+   * every cable is given once from each end
+   */
+  size_t get_edge_count() const { return edges.size(); }
+  
+  /**
+   * @brief get first edge of entity
+   * @param entity entity id
+   */
+  const edge_t * begin(const uint32_t entity) const { return edges.empty() ? NULL : &edges.front() + offsets[entity]; }
+  
+  /**
+   * @brief get end of edges of entity
+   * @param entity entity id
+   */
+  const edge_t * end(const uint32_t entity) const { return edges.empty() ? NULL : &edges.front() + offsets[entity + 1]; }
+  
+  /**
+   * @brief get number of edges of entity
+   * @param entity entity id
+   */
+  size_t degree(const uint32_t entity) const { return offsets[entity + 1] - offsets[entity]; }
+  
+  /**
+   * @brief get edge offset of every entity (vertex count + 1 offsets)
+   */
+  const offsets_t & get_offsets() const { return offsets; }
+  
+  /**
+   * @brief get every edge
+   */
+  const edges_t & get_edges() const { return edges; }
+  
+  /**
+   * @brief order entities by topology (Cuthill-McKee)
+   * @param order set to the old entity id of every new entity id
+   * 
+   * Every connected component is walked breadth first from its
+   * lowest degree vertex and the neighbours of every vertex are
+   * visited by increasing degree. Vertices with a single edge
+   * (HCAs on a full graph) are placed directly after their only
+   * neighbour, so every leaf switch is followed by its HCAs and
+   * neighbours get close ids.
+   * 
+   * @see fabric_t::renumber_entities()
+   */
+  void cuthill_mckee(order_t &order) const;
+  
+private:
+  /**
+   * @brief graph variant
+   */
+  variant_t variant;
+  
+  /**
+   * @brief edge offset of every entity
+   */
+  offsets_t offsets;
+  
+  /**
+   * @brief every edge
+   */
+  edges_t edges;
+};
+
+}
+
+#endif  // IB_GRAPH_H
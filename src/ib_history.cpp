@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ib_history.h"
+#include<cassert>
+#include<algorithm>
+
+namespace infiniband {
+
+/**
+ * @brief compare every port property except the connection
+ */
+static bool same_port(const port_t &a, const port_t &b)
+{
+  return 
+    a.guid == b.guid && 
+    a.port == b.port && 
+    a.type == b.type && 
+    a.hca == b.hca &&
+    a.lid == b.lid && 
+    a.lmc == b.lmc && 
+    a.width == b.width && 
+    a.speed == b.speed && 
+    a.name == b.name && 
+    a.leaf == b.leaf && 
+    a.spine == b.spine;
+}
+
+/**
+ * @brief fill port change from port
+ */
+static void make_port_change(const port_t &port, fabric_history_t::port_change_t &change)
+{
+  change.port = port;
+  change.port.connection = NULL;
+  change.remote_guid = port.connection ? port.connection->guid : 0;
+  change.remote_port = port.connection ? port.connection->port : 0;
+  change.removed = false;
+}
+
+/**
+ * @brief find next page allocated in either table
+ * @return page index or past the end of both tables if there is none
+ */
+template<typename table_t>
+static size_t next_page(const table_t &before, const table_t &after, const size_t index)
+{
+  const size_t end = std::max(before.get_directory_size(), after.get_directory_size());
+  
+  size_t a = before.next_page(index);
+  if(a >= before.get_directory_size())
+    a = end;
+  
+  size_t b = after.next_page(index);
+  if(b >= after.get_directory_size())
+    b = end;
+  
+  return std::min(a, b);
+}
+
+/**
+ * @brief order route changes by lid
+ */
+struct route_change_lid_less_t {
+  bool operator()(const fabric_history_t::route_change_t &change, const uint32_t lid) const { return change.lid < lid; }
+};
+
+uint32_t fabric_history_t::find_node(const guid_t guid) const
+{
+  const std::map<guid_t, uint32_t>::const_iterator itr = nodeids.find(guid);
+  return itr == nodeids.end() ? fabric_t::no_entity : itr->second;
+}
+
+uint32_t fabric_history_t::get_node(const guid_t guid)
+{
+  const std::pair<std::map<guid_t, uint32_t>::iterator, bool> result = 
+    nodeids.insert(std::make_pair(guid, static_cast<uint32_t>(nodes.size())));
+  
+  if(result.second)
+    nodes.push_back(guid);
+  
+  return result.first->second;
+}
+
+void fabric_history_t::get_range(const size_t snapshot, size_t &first, size_t &last, size_t &first_route, size_t &last_route) const
+{
+  assert(snapshot < snapshots.size());
+  
+  first = snapshots[snapshot].ports;
+  first_route = snapshots[snapshot].routes;
+  
+  if(snapshot + 1 < snapshots.size())
+  {
+    last = snapshots[snapshot + 1].ports;
+    last_route = snapshots[snapshot + 1].routes;
+  }
+  else
+  {
+    last = port_changes.size();
+    last_route = route_changes.size();
+  }
+}
+
+void fabric_history_t::diff_tables(const uint32_t node, const plft_num_t plft, const table_t &before, const table_t &after)
+{
+  const size_t pages = std::max(before.get_directory_size(), after.get_directory_size());
+  const port_num_t unreachable = entity_t::unicast_forwarding_table_t::unreachable;
+  const size_t first = route_changes.size();
+  
+  ///only pages allocated in either table can differ
+  for(size_t dir = next_page(before, after, 0); dir < pages; dir = next_page(before, after, dir + 1))
+  {
+    const table_t::page_t * const a = before.get_page(dir);
+    const table_t::page_t * const b = after.get_page(dir);
+    
+    ///shared or identical pages have no changes
+    if(a == b || (a && b && std::equal(a->values, a->values + table_t::page_size, b->values)))
+      continue;
+    
+    const lid_t base = static_cast<lid_t>(dir) << table_t::page_bits;
+    for(size_t i = 0; i < table_t::page_size; ++i)
+    {
+      const port_num_t old_port = a ? a->values[i] : unreachable;
+      const port_num_t new_port = b ? b->values[i] : unreachable;
+      if(old_port == new_port)
+        continue;
+      
+      ///unicast lids always fit
+      assert(base + i <= MAX_LID_VALUE);
+      
+      route_change_t change;
+      change.node = node;
+      change.lid = static_cast<uint32_t>(base + i);
+      change.plft = plft;
+      change.port = new_port;
+      route_changes.push_back(change);
+    }
+  }
+  
+  ///pages and lids are walked in order so the range is sorted by lid
+  if(first != route_changes.size())
+  {
+    table_range_t range;
+    range.snapshot = snapshots.size();
+    range.first = first;
+    range.last = route_changes.size();
+    table_index[table_key_t(node, plft)].push_back(range);
+  }
+}
+
+bool fabric_history_t::append(const fabric_t &fabric, const time_t time)
+{
+  snapshot_t snapshot;
+  snapshot.time = time;
+  snapshot.ports = port_changes.size();
+  snapshot.routes = route_changes.size();
+  snapshot.lmc = fabric.get_lmc();
+  snapshot.exact_lids = fabric.has_exact_port_lids();
+  
+  /**
+   * Walk fabric ports and newest ports together 
+   * (both are ordered by guid and port)
+   */
+  {
+    const fabric_t::portmap_guidport_t &portmap = fabric.get_portmap();
+    fabric_t::portmap_guidport_t::const_iterator itr = portmap.begin();
+    ports_t::iterator pitr = ports.begin();
+    port_change_t change;
+    
+    while(itr != portmap.end() || pitr != ports.end())
+    {
+      if(itr == portmap.end() || (pitr != ports.end() && pitr->first < itr->first))
+      {
+        ///port removed
+        pitr->second.removed = true;
+        port_changes.push_back(pitr->second);
+        ports.erase(pitr++);
+        continue;
+      }
+      
+      make_port_change(*itr->second, change);
+      
+      if(pitr == ports.end() || itr->first < pitr->first)
+      {
+        ///port added
+        get_node(itr->second->guid);
+        port_changes.push_back(change);
+        ports.insert(pitr, std::make_pair(itr->first, change));
+        ++itr;
+        continue;
+      }
+      
+      if(
+        !same_port(pitr->second.port, change.port) ||
+        pitr->second.remote_guid != change.remote_guid ||
+        pitr->second.remote_port != change.remote_port
+      )
+      {
+        port_changes.push_back(change);
+        pitr->second = change;
+      }
+      
+      ++itr;
+      ++pitr;
+    }
+  }
+  
+  /**
+   * Compare every forwarding table against the newest table
+   * Copies share pages with the fabric so unchanged pages 
+   * are skipped without a compare on the next snapshot
+   */
+  {
+    tables_t found;
+    const fabric_t::entities_t &entities = fabric.get_entities();
+    
+    for(size_t i = 0; i < entities.size(); ++i)
+    {
+      const entity_t &entity = entities[i];
+      const uint32_t node = get_node(entity.guid);
+      
+      for(size_t plft = 0; plft < entity.get_plft_count(); ++plft)
+      {
+        const table_t &table = entity.get_uft(static_cast<plft_num_t>(plft)).get_ports();
+        if(table.empty())
+          continue;
+        
+        const table_key_t key(node, static_cast<plft_num_t>(plft));
+        const tables_t::iterator titr = tables.find(key);
+        
+        diff_tables(node, key.second, titr == tables.end() ? table_t(table.get_fill()) : titr->second, table);
+        found.insert(std::make_pair(key, table));
+      }
+    }
+    
+    ///every route of tables no longer given was removed
+    for(tables_t::const_iterator itr = tables.begin(); itr != tables.end(); ++itr)
+      if(found.find(itr->first) == found.end())
+        diff_tables(itr->first.first, itr->first.second, itr->second, table_t(itr->second.get_fill()));
+    
+    tables.swap(found);
+  }
+  
+  snapshots.push_back(snapshot);
+  return true;
+}
+
+bool fabric_history_t::rebuild(const size_t snapshot, fabric_t &fabric) const
+{
+  if(snapshot >= snapshots.size())
+  {
+    std::cerr << "unknown snapshot " << snapshot << std::endl;
+    return false;
+  }
+  
+  if(!fabric.get_entities().empty() || !fabric.get_portmap().empty())
+  {
+    std::cerr << "snapshot can only be rebuilt into an empty fabric" << std::endl;
+    return false;
+  }
+  
+  ///Fabric is rebuilt aside so a failure leaves fabric empty
+  fabric_t rebuilt;
+  if(fabric.get_page_store() && !rebuilt.set_page_store(fabric.get_page_store()))
+    return false;
+  
+  ///Replay every change up to snapshot
+  size_t first, last, first_route, last_route;
+  get_range(snapshot, first, last, first_route, last_route);
+  
+  ports_t state;
+  for(size_t i = 0; i < last; ++i)
+  {
+    const port_change_t &change = port_changes[i];
+    const port_t::key_guid_port_t key(change.port.guid, change.port.port);
+    
+    if(change.removed)
+      state.erase(key);
+    else
+    {
+      const std::pair<ports_t::iterator, bool> result = state.insert(std::make_pair(key, change));
+      if(!result.second)
+        result.first->second = change;
+    }
+  }
+  
+  tables_t routes;
+  for(size_t i = 0; i < last_route; ++i)
+  {
+    const route_change_t &change = route_changes[i];
+    const table_key_t key(change.node, change.plft);
+    
+    tables_t::iterator itr = routes.find(key);
+    if(itr == routes.end())
+      itr = routes.insert(std::make_pair(key, table_t(entity_t::unicast_forwarding_table_t::unreachable))).first;
+    
+    itr->second.set(change.lid, change.port);
+  }
+  
+  ///Create every port in the fabric arena then connect cables
+  fabric_t::portmap_guidport_t portmap;
+  for(ports_t::const_iterator itr = state.begin(); itr != state.end(); ++itr)
+    portmap.insert(std::make_pair(itr->first, rebuilt.get_port_arena().create(itr->second.port)));
+  
+  for(ports_t::const_iterator itr = state.begin(); itr != state.end(); ++itr)
+  {
+    if(!itr->second.remote_guid)
+      continue;
+    
+    const fabric_t::portmap_guidport_t::const_iterator ritr = 
+      portmap.find(port_t::key_guid_port_t(itr->second.remote_guid, itr->second.remote_port));
+    assert(ritr != portmap.end());
+    if(ritr != portmap.end())
+      portmap[itr->first]->connection = ritr->second;
+  }
+  
+  if(!rebuilt.add_cables(portmap))
+    return false;
+  
+  if(snapshots[snapshot].exact_lids)
+  {
+    for(ports_t::const_iterator itr = state.begin(); itr != state.end(); ++itr)
+      if(itr->second.port.lid > 0 && !rebuilt.set_port_lid(itr->first.guid, itr->first.port, itr->second.port.lid, itr->second.port.lmc))
+        return false;
+  }
+  
+  ///lmc is restored instead of guessed from the lids
+  if(!rebuilt.set_lmc(snapshots[snapshot].lmc) || !rebuilt.build_lid_map())
+    return false;
+  
+  ///Add every route
+  for(tables_t::const_iterator itr = routes.begin(); itr != routes.end(); ++itr)
+  {
+    const guid_t guid = nodes[itr->first.first];
+    const table_t &table = itr->second;
+    
+    for(size_t dir = table.next_page(0); dir < table.get_directory_size(); dir = table.next_page(dir + 1))
+    {
+      const table_t::page_t * const page = table.get_page(dir);
+      
+      const lid_t base = static_cast<lid_t>(dir) << table_t::page_bits;
+      for(size_t i = 0; i < table_t::page_size; ++i)
+        if(page->values[i] != table.get_fill())
+          if(!rebuilt.add_route(guid, page->values[i], base + i, itr->first.second))
+            return false;
+    }
+  }
+  
+  if(!rebuilt.build_forwarding_table())
+    return false;
+  
+  fabric = std::move(rebuilt);
+  return true;
+}
+
+bool fabric_history_t::find_route_changes(const guid_t guid, const lid_t lid, route_events_t &events, const plft_num_t plft) const
+{
+  events.clear();
+  
+  const uint32_t node = find_node(guid);
+  if(node == fabric_t::no_entity)
+    return false;
+  
+  const table_index_t::const_iterator itr = table_index.find(table_key_t(node, plft));
+  if(itr == table_index.end() || lid > MAX_LID_VALUE)
+    return true;
+  
+  ///every table changes a lid at most once per snapshot
+  const table_ranges_t &ranges = itr->second;
+  for(table_ranges_t::const_iterator ritr = ranges.begin(); ritr != ranges.end(); ++ritr)
+  {
+    const route_changes_t::const_iterator last = route_changes.begin() + ritr->last;
+    const route_changes_t::const_iterator change = std::lower_bound(
+      route_changes.begin() + ritr->first, last, static_cast<uint32_t>(lid), route_change_lid_less_t()
+    );
+    
+    if(change == last || change->lid != lid)
+      continue;
+    
+    route_event_t event;
+    event.snapshot = ritr->snapshot;
+    event.time = snapshots[ritr->snapshot].time;
+    event.port = change->port;
+    events.push_back(event);
+  }
+  
+  return true;
+}
+
+void fabric_history_t::clear()
+{
+  snapshots.clear();
+  port_changes.clear();
+  route_changes.clear();
+  table_index.clear();
+  nodes.clear();
+  nodeids.clear();
+  ports.clear();
+  tables.clear();
+}
+
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "ib_port.h"
+#include "ib_fabric.h"
+#include<vector>
+#include<map>
+#include<ctime>
+#if __cplusplus <= 199711L
+#include<stdint.h>
+#else
+#include<cstdint>
+#endif ///cplusplus
+
+#ifndef IB_HISTORY_H
+#define IB_HISTORY_H
+
+namespace infiniband {
+
+/**
+ * @brief append only history of fabric snapshots
+ * Holds the changes of every snapshot against the previous
+ * snapshot instead of every fabric. The first snapshot is the 
+ * base (every port and route is a change against an empty fabric)
+ * and every later snapshot only holds the ports, cables and LFT 
+ * entries that changed.
+ * 
+ * Entities are given history node ids by GUID on first sight
+ * which never change, so changes of every snapshot refer to the 
+ * same node no matter how the source fabric numbered its entities.
+ * 
+ * Changes are held in two flat arrays (ports and routes) and every
+ * snapshot is a range of each array. 
+ */
+class fabric_history_t {
+public:
+  /**
+   * @brief port change
+   * Holds the state of a port after the change
+   */
+  struct port_change_t {
+    /**
+     * @brief port properties (connection is always NULL)
+     */
+    port_t port;
+    /**
+     * @brief guid of connected port (0 if dark)
+     */
+    guid_t remote_guid;
+    /**
+     * @brief port number of connected port
+     */
+    port_num_t remote_port;
+    /**
+     * @brief true if port was removed
+     */
+    bool removed;
+  };
+  typedef std::vector<port_change_t> port_changes_t;
+  
+  /**
+   * @brief LFT entry change
+   */
+  struct route_change_t {
+    /**
+     * @brief history node id of switch
+     */
+    uint32_t node;
+    /**
+     * @brief destination lid
+     */
+    uint32_t lid;
+    /**
+     * @brief PLFT of route
+     */
+    plft_num_t plft;
+    /**
+     * @brief new egress port (unreachable if route was removed)
+     */
+    port_num_t port;
+  };
+  typedef std::vector<route_change_t> route_changes_t;
+  
+  /**
+   * @brief route change found by find_route_changes()
+   */
+  struct route_event_t {
+    /**
+     * @brief snapshot with the change
+     */
+    size_t snapshot;
+    /**
+     * @brief time of snapshot
+     */
+    time_t time;
+    /**
+     * @brief new egress port (unreachable if route was removed)
+     */
+    port_num_t port;
+  };
+  typedef std::vector<route_event_t> route_events_t;
+  
+  /**
+   * @brief append fabric as newest snapshot
+   * @param fabric fabric to append (with lid map and routes)
+   * @param time time of snapshot
+   * @return true on success
+   * @note forwarding tables are only compared where pages differ
+   */
+  bool append(const fabric_t &fabric, const time_t time);
+  
+  /**
+   * @brief rebuild fabric of snapshot
+   * @param snapshot snapshot to rebuild (0 is the base)
+   * @param fabric fabric to populate (must be empty and is left empty on failure)
+   * @return true on success
+   * @note lmc, lid map and forwarding tables are restored
+   */
+  bool rebuild(const size_t snapshot, fabric_t &fabric) const;
+  
+  /**
+   * @brief find every change of a route
+   * @param guid switch guid
+   * @param lid destination lid
+   * @param events set to every change of the route (oldest first)
+   * @param plft PLFT of route
+   * @return true if switch is known
+   * @note only snapshots changing the forwarding table of the switch are searched
+   */
+  bool find_route_changes(const guid_t guid, const lid_t lid, route_events_t &events, const plft_num_t plft = 0) const;
+  
+  /**
+   * @brief get number of snapshots
+   */
+  size_t size() const { return snapshots.size(); }
+  
+  /**
+   * @brief check if history has no snapshots
+   */
+  bool empty() const { return snapshots.empty(); }
+  
+  /**
+   * @brief get time of snapshot
+   * @param snapshot snapshot index
+   */
+  time_t get_time(const size_t snapshot) const { return snapshots[snapshot].time; }
+  
+  /**
+   * @brief get every port change of every snapshot
+   */
+  const port_changes_t & get_port_changes() const { return port_changes; }
+  
+  /**
+   * @brief get every route change of every snapshot
+   */
+  const route_changes_t & get_route_changes() const { return route_changes; }
+  
+  /**
+   * @brief find history node id of guid
+   * @param guid entity guid
+   * @return node id or fabric_t::no_entity if never seen
+   */
+  uint32_t find_node(const guid_t guid) const;
+  
+  /**
+   * @brief get guid of history node
+   * @param node history node id
+   */
+  guid_t get_node_guid(const uint32_t node) const { return nodes[node]; }
+  
+  /**
+   * @brief clear every snapshot
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief snapshot entry
+   */
+  struct snapshot_t {
+    /**
+     * @brief time of snapshot
+     */
+    time_t time;
+    /**
+     * @brief first port change of snapshot
+     */
+    size_t ports;
+    /**
+     * @brief first route change of snapshot
+     */
+    size_t routes;
+    /**
+     * @brief fabric lmc
+     */
+    lmc_t lmc;
+    /**
+     * @brief true if port lids were exact
+     */
+    bool exact_lids;
+  };
+  
+  /**
+   * @brief forwarding table key (node, plft)
+   */
+  typedef std::pair<uint32_t, plft_num_t> table_key_t;
+  typedef entity_t::unicast_forwarding_table_t::ports_t table_t;
+  typedef std::map<table_key_t, table_t> tables_t;
+  typedef std::map<port_t::key_guid_port_t, port_change_t> ports_t;
+  
+  /**
+   * @brief route changes of one forwarding table in one snapshot
+   * changes of a range are in ascending lid order
+   */
+  struct table_range_t {
+    /**
+     * @brief snapshot index
+     */
+    size_t snapshot;
+    /**
+     * @brief first route change
+     */
+    size_t first;
+    /**
+     * @brief end of route changes
+     */
+    size_t last;
+  };
+  typedef std::vector<table_range_t> table_ranges_t;
+  typedef std::map<table_key_t, table_ranges_t> table_index_t;
+  
+  /**
+   * @brief get history node id of guid (added if not known)
+   */
+  uint32_t get_node(const guid_t guid);
+  
+  /**
+   * @brief get range of changes of snapshot
+   * @param snapshot snapshot index
+   * @param first set to first port change
+   * @param last set to end of port changes
+   * @param first_route set to first route change
+   * @param last_route set to end of route changes
+   */
+  void get_range(const size_t snapshot, size_t &first, size_t &last, size_t &first_route, size_t &last_route) const;
+  
+  /**
+   * @brief add route changes between two tables
+   * @param node history node id
+   * @param plft PLFT of table
+   * @param before table of previous snapshot
+   * @param after table of new snapshot
+   */
+  void diff_tables(const uint32_t node, const plft_num_t plft, const table_t &before, const table_t &after);
+  
+  /**
+   * @brief every snapshot (oldest first)
+   */
+  std::vector<snapshot_t> snapshots;
+  
+  /**
+   * @brief port changes of every snapshot
+   */
+  port_changes_t port_changes;
+  
+  /**
+   * @brief route changes of every snapshot
+   */
+  route_changes_t route_changes;
+  
+  /**
+   * @brief route change ranges of every forwarding table (oldest first)
+   */
+  table_index_t table_index;
+  
+  /**
+   * @brief guid of every history node
+   */
+  std::vector<guid_t> nodes;
+  
+  /**
+   * @brief history node id of every guid
+   */
+  std::map<guid_t, uint32_t> nodeids;
+  
+  /**
+   * @brief port state of newest snapshot
+   */
+  ports_t ports;
+  
+  /**
+   * @brief forwarding tables of newest snapshot
+   * tables share pages with the appended fabrics
+   */
+  tables_t tables;
+};
+
+}
+
+#endif  // IB_HISTORY_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ib_page_store.h"
+#include<iostream>
+#include<cassert>
+#include<cstring>
+#include<cerrno>
+#include<cstdlib>
+#include<sys/mman.h>
+#include<sys/types.h>
+#include<fcntl.h>
+#include<unistd.h>
+
+namespace infiniband {
+
+const size_t page_store_t::default_segment_blocks = 16384;
+
+page_store_t::page_store_t()
+  : fd(-1), block_size(0), segment_size(0), used(0), count(0)
+{
+}
+
+page_store_t::~page_store_t()
+{
+  close();
+}
+
+bool page_store_t::open(const std::string &directory, const size_t block_size, const size_t segment_blocks)
+{
+  assert(block_size > 0);
+  assert(segment_blocks > 0);
+  
+  std::lock_guard<std::mutex> guard(lock);
+  close();
+  
+  ///mkstemp() always creates a new file
+  std::string path = directory + "/ibautils-pages-XXXXXX";
+  fd = mkstemp(&path[0]);
+  if(fd == -1)
+  {
+    std::cerr << "unable to create page store in " << directory << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  
+  ///file is only backing storage
+  if(unlink(path.c_str()))
+    std::cerr << "unable to unlink page store " << path << ": " << strerror(errno) << std::endl;
+  
+  ///segments start on OS page boundaries
+  const size_t os_page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  this->block_size = block_size;
+  segment_size = block_size * segment_blocks;
+  segment_size = (segment_size + os_page - 1) / os_page * os_page;
+  
+  if(!grow())
+  {
+    close();
+    return false;
+  }
+  
+  return true;
+}
+
+bool page_store_t::grow()
+{
+  assert(fd != -1);
+  
+  const off_t offset = static_cast<off_t>(segments.size()) * static_cast<off_t>(segment_size);
+  
+  if(ftruncate(fd, offset + static_cast<off_t>(segment_size)))
+  {
+    std::cerr << "unable to grow page store: " << strerror(errno) << std::endl;
+    return false;
+  }
+  
+  void * const base = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+  if(base == MAP_FAILED)
+  {
+    std::cerr << "unable to map page store: " << strerror(errno) << std::endl;
+    return false;
+  }
+  
+  segments.push_back(static_cast<char *>(base));
+  used = 0;
+  return true;
+}
+
+void page_store_t::close()
+{
+  for(size_t i = 0; i < segments.size(); ++i)
+    munmap(segments[i], segment_size);
+  segments.clear();
+  released.clear();
+  used = 0;
+  count = 0;
+  
+  if(fd != -1)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+void * page_store_t::allocate()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  
+  if(fd == -1)
+    return NULL;
+  
+  void *block = NULL;
+  if(!released.empty())
+  {
+    block = released.back();
+    released.pop_back();
+  }
+  else
+  {
+    if(used + block_size > segment_size && !grow())
+      return NULL;
+    
+    block = segments.back() + used;
+    used += block_size;
+  }
+  
+  ++count;
+  return block;
+}
+
+void page_store_t::release(void * const block)
+{
+  assert(block);
+  
+  std::lock_guard<std::mutex> guard(lock);
+  
+  assert(count > 0);
+  --count;
+  released.push_back(block);
+}
+
+size_t page_store_t::size() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return count;
+}
+
+size_t page_store_t::get_segment_count() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return segments.size();
+}
+
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include<string>
+#include<vector>
+#include<mutex>
+#include<memory>
+
+#ifndef IB_PAGE_STORE_H
+#define IB_PAGE_STORE_H
+
+namespace infiniband {
+
+/**
+ * @brief memory mapped block store
+ * Hands out fixed size blocks from a file mapped in segments so 
+ * the kernel page cache decides which blocks stay in RAM and 
+ * blocks can be written back to the file instead of swap.
+ * 
+ * The file grows one segment at a time and every segment is 
+ * mapped once, so blocks never move while the store exists.
+ * The file is created with a unique name in a given directory 
+ * and unlinked right away (it is only backing storage and is gone
+ * once the store is destroyed). Existing files are never touched.
+ * 
+ * @see paged_table_t::set_store()
+ */
+class page_store_t {
+public:
+  /**
+   * @brief ctor
+   * store is closed until open() is called
+   */
+  page_store_t();
+  
+  /**
+   * @brief dtor
+   * unmaps every segment (every block is invalid afterwards)
+   */
+  ~page_store_t();
+  
+  /**
+   * @brief create backing file and map first segment
+   * @param directory directory to create backing file in
+   * @param block_size size of every block in bytes
+   * @param segment_blocks number of blocks mapped at a time
+   * @return true on success
+   */
+  bool open(const std::string &directory, const size_t block_size, const size_t segment_blocks = default_segment_blocks);
+  
+  /**
+   * @brief check if store is open
+   */
+  bool is_open() const { return fd != -1; }
+  
+  /**
+   * @brief allocate block
+   * @return ptr to block or NULL if file could not grow
+   * @note block content is undefined
+   */
+  void * allocate();
+  
+  /**
+   * @brief release block allocated by allocate()
+   * @param block block to release
+   */
+  void release(void * const block);
+  
+  /**
+   * @brief get size of every block
+   */
+  size_t get_block_size() const { return block_size; }
+  
+  /**
+   * @brief get number of blocks in use
+   */
+  size_t size() const;
+  
+  /**
+   * @brief get number of mapped segments
+   */
+  size_t get_segment_count() const;
+  
+  /**
+   * @brief default number of blocks per segment
+   * 16384 blocks of LFT pages is 64MiB
+   */
+  static const size_t default_segment_blocks;
+  
+private:
+  page_store_t(const page_store_t &);
+  page_store_t &operator=(const page_store_t &);
+  
+  /**
+   * @brief grow file and map one more segment
+   * @return true on success
+   * @warning lock must be held
+   */
+  bool grow();
+  
+  /**
+   * @brief unmap every segment and close file
+   */
+  void close();
+  
+  /**
+   * @brief backing file descriptor (-1 if closed)
+   */
+  int fd;
+  
+  /**
+   * @brief size of every block
+   */
+  size_t block_size;
+  
+  /**
+   * @brief size of every segment in bytes (multiple of OS page size)
+   */
+  size_t segment_size;
+  
+  /**
+   * @brief base of every mapped segment
+   */
+  std::vector<char *> segments;
+  
+  /**
+   * @brief offset of next unused block in newest segment
+   */
+  size_t used;
+  
+  /**
+   * @brief released blocks
+   */
+  std::vector<void *> released;
+  
+  /**
+   * @brief number of blocks in use
+   */
+  size_t count;
+  
+  /**
+   * @brief guards every member (pages are released by any owner)
+   */
+  mutable std::mutex lock;
+};
+
+}
+
+#endif  // IB_PAGE_STORE_H
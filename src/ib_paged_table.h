@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "ib_port.h"
+#include "ib_page_store.h"
+#include<vector>
+#include<map>
+#include<memory>
+
+#ifndef IB_PAGED_TABLE_H
+#define IB_PAGED_TABLE_H
+
+namespace infiniband {
+
+/**
+ * @brief paged table indexed by LID
+ * LIDs are split into a chunk index (upper bits), a page index in
+ * the chunk (next 8 bits) and an offset into a page of 4096 values
+ * (lower 12 bits). Chunks of 256 pages (1M LIDs) and pages are only
+ * allocated once a LID in them is set, so memory follows the 
+ * populated LIDs instead of the highest LID (only the top level 
+ * grows with the highest LID at one pointer per 1M LIDs). This 
+ * allows extended (32 bit) LIDs without flat arrays.
+ * 
+ * Chunks and pages are reference counted. Copies of a table share 
+ * every chunk and page and a shared chunk or page is only copied 
+ * when it is changed (copy on write). 
+ * Identical pages of different tables can be shared with share().
+ * Pages are allocated on the heap unless the table is given a 
+ * memory mapped page store (set_store()).
+ * 
+ * Unset values (and pages) always hold the fill value.
+ */
+template<typename T>
+class paged_table_t {
+public:
+  /**
+   * @brief LID bits of page offset
+   */
+  static const unsigned int page_bits = 12;
+  
+  /**
+   * @brief values per page
+   */
+  static const size_t page_size = static_cast<size_t>(1) << page_bits;
+  
+  /**
+   * @brief page index bits of chunk
+   */
+  static const unsigned int chunk_bits = 8;
+  
+  /**
+   * @brief pages per chunk
+   */
+  static const size_t chunk_size = static_cast<size_t>(1) << chunk_bits;
+  
+  /**
+   * @brief page of values
+   */
+  struct page_t {
+    T values[page_size];
+  };
+  typedef std::shared_ptr<page_t> shared_page_t;
+  
+  /**
+   * @brief store page of every page moved by set_store()
+   */
+  typedef std::map<const page_t *, shared_page_t> moved_pages_t;
+  
+  /**
+   * @brief pool of unique pages used to share identical pages
+   * @see share()
+   */
+  class page_pool_t {
+  public:
+    /**
+     * @brief find identical page in pool
+     * @param page page to find (added to pool if not found)
+     * @return pooled page identical to page
+     */
+    shared_page_t intern(const shared_page_t &page);
+    
+    /**
+     * @brief get number of unique pages
+     */
+    size_t size() const { return pages.size(); }
+    
+  private:
+    /**
+     * @brief every unique page by content hash
+     */
+    std::multimap<size_t, shared_page_t> pages;
+  };
+  
+  /**
+   * @brief ctor
+   * @param fill value of every unset LID
+   */
+  explicit paged_table_t(const T &fill) : fill(fill), lid_count(0) {}
+  
+  /**
+   * @brief find value of LID
+   * @param lid LID to find
+   * @return value or fill value if not set
+   */
+  const T & find(const lid_t lid) const
+  {
+    const lid_t index = lid >> (page_bits + chunk_bits);
+    if(index >= chunks.size() || !chunks[index])
+      return fill;
+    
+    const page_t * const page = chunks[index]->pages[(lid >> page_bits) & (chunk_size - 1)].get();
+    return page ? page->values[lid & (page_size - 1)] : fill;
+  }
+  
+  /**
+   * @brief set value of LID
+   * @param lid LID to set
+   * @param value new value
+   * @param previous previous value of LID (ignored if NULL)
+   * @return true on success or false if store is full
+   * @note copies page first if page is shared
+   */
+  bool set(const lid_t lid, const T &value, T * const previous = NULL);
+  
+  /**
+   * @brief get number of LIDs held (highest set LID + 1)
+   */
+  size_t size() const { return lid_count; }
+  
+  /**
+   * @brief check if table has no LIDs
+   */
+  bool empty() const { return !lid_count; }
+  
+  /**
+   * @brief get fill value
+   */
+  const T & get_fill() const { return fill; }
+  
+  /**
+   * @brief get number of page indexes (past the highest chunk)
+   */
+  size_t get_directory_size() const { return chunks.size() << chunk_bits; }
+  
+  /**
+   * @brief get page
+   * @param index page index (LID >> page_bits)
+   * @return page or NULL if page is not allocated (every value is fill)
+   */
+  const page_t * get_page(const size_t index) const 
+  { 
+    const size_t chunk = index >> chunk_bits;
+    if(chunk >= chunks.size() || !chunks[chunk])
+      return NULL;
+    
+    return chunks[chunk]->pages[index & (chunk_size - 1)].get(); 
+  }
+  
+  /**
+   * @brief find next allocated page
+   * @param index first page index to check
+   * @return page index or get_directory_size() if there is none
+   * @note skips unallocated chunks without checking their pages
+   */
+  size_t next_page(size_t index) const;
+  
+  /**
+   * @brief replace every value of a page
+   * @param index directory index (LID >> page_bits)
+   * @param page values of page (copied)
+   * @return true on success or false if store is full
+   */
+  bool set_page(const size_t index, const page_t &page);
+  
+  /**
+   * @brief get number of allocated pages
+   */
+  size_t get_page_count() const;
+  
+  /**
+   * @brief release pages holding only fill values and trailing LIDs
+   */
+  void shrink();
+  
+  /**
+   * @brief share identical pages with pool
+   * @param pool pool of pages (shared by every table to share pages between)
+   */
+  void share(page_pool_t &pool);
+  
+  /**
+   * @brief allocate every page in store
+   * @param store store to allocate pages in (heap if NULL)
+   * @param moved pages already moved into store (NULL if not shared with other tables)
+   * @return true on success or false if store is full (pages not moved yet stay on their previous store)
+   * @note every allocated page is copied into store once, pages shared 
+   *    by tables given the same moved pages stay shared
+   * @warning store block size must hold a page
+   */
+  bool set_store(const std::shared_ptr<page_store_t> &store, moved_pages_t * const moved = NULL);
+  
+  /**
+   * @brief get store pages are allocated in (NULL for heap)
+   */
+  const std::shared_ptr<page_store_t> & get_store() const { return store; }
+  
+  /**
+   * @brief clear every LID
+   */
+  void clear() { chunks.clear(); lid_count = 0; }
+  
+  /**
+   * @brief compare value of every LID
+   * @note LIDs past the end of either table are fill
+   */
+  bool operator==(const paged_table_t &other) const;
+  bool operator!=(const paged_table_t &other) const { return !(*this == other); }
+  
+private:
+  /**
+   * @brief chunk of pages
+   */
+  struct chunk_t {
+    shared_page_t pages[chunk_size];
+  };
+  typedef std::shared_ptr<chunk_t> shared_chunk_t;
+  
+  /**
+   * @brief get chunk to change
+   * @param index chunk index (LID >> (page_bits + chunk_bits))
+   * @return chunk (allocated or copied first if shared)
+   */
+  chunk_t & get_chunk(const size_t index);
+  
+  /**
+   * @brief return page to the store it was allocated in
+   * holds the store until every page of the store is released
+   */
+  struct store_deleter_t {
+    std::shared_ptr<page_store_t> store;
+    
+    void operator()(page_t * const page) const 
+    { 
+      page->~page_t(); 
+      store->release(page); 
+    }
+  };
+  
+  /**
+   * @brief allocate page (in store if given)
+   * @param copy page to copy or NULL to fill page with fill value
+   * @return page or NULL if store is full
+   */
+  shared_page_t allocate_page(const page_t * const copy) const;
+  
+  /**
+   * @brief check if every value of page is fill
+   */
+  bool is_fill(const page_t &page) const;
+  
+  /**
+   * @brief value of unset LIDs
+   */
+  T fill;
+  
+  /**
+   * @brief chunk of every 1M LIDs (NULL if not allocated)
+   */
+  std::vector<shared_chunk_t> chunks;
+  
+  /**
+   * @brief highest set LID + 1
+   */
+  size_t lid_count;
+  
+  /**
+   * @brief store of new pages (NULL for heap)
+   */
+  std::shared_ptr<page_store_t> store;
+};
+
+}
+
+#include "ib_paged_table.tpp"
+
+#endif  // IB_PAGED_TABLE_H
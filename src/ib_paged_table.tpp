@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include<vector>
+#include<cassert>
+#include<algorithm>
+#include<cstring>
+#include<new>
+
+namespace infiniband {
+
+template<typename T>
+const unsigned int paged_table_t<T>::page_bits;
+
+template<typename T>
+const size_t paged_table_t<T>::page_size;
+
+template<typename T>
+const unsigned int paged_table_t<T>::chunk_bits;
+
+template<typename T>
+const size_t paged_table_t<T>::chunk_size;
+
+template<typename T>
+typename paged_table_t<T>::chunk_t & paged_table_t<T>::get_chunk(const size_t index)
+{
+  if(index >= chunks.size())
+    chunks.resize(index + 1);
+  
+  shared_chunk_t &chunk = chunks[index];
+  if(!chunk)
+    chunk.reset(new chunk_t());
+  else if(!chunk.unique())
+    chunk.reset(new chunk_t(*chunk));
+  
+  return *chunk;
+}
+
+template<typename T>
+size_t paged_table_t<T>::next_page(size_t index) const
+{
+  for(size_t chunk = index >> chunk_bits; chunk < chunks.size(); ++chunk, index = chunk << chunk_bits)
+  {
+    if(!chunks[chunk])
+      continue;
+    
+    for(size_t page = index & (chunk_size - 1); page < chunk_size; ++page)
+      if(chunks[chunk]->pages[page])
+        return (chunk << chunk_bits) | page;
+  }
+  
+  return get_directory_size();
+}
+
+template<typename T>
+typename paged_table_t<T>::shared_page_t paged_table_t<T>::page_pool_t::intern(const shared_page_t &page)
+{
+  assert(page);
+  
+  ///FNV-1a over page bytes
+  const unsigned char * const bytes = reinterpret_cast<const unsigned char *>(page->values);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for(size_t i = 0; i < sizeof(page->values); ++i)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  
+  typedef typename std::multimap<size_t, shared_page_t>::const_iterator itr_t;
+  const std::pair<itr_t, itr_t> range = pages.equal_range(static_cast<size_t>(hash));
+  for(itr_t itr = range.first; itr != range.second; ++itr)
+    if(itr->second == page || std::equal(page->values, page->values + page_size, itr->second->values))
+      return itr->second;
+  
+  pages.insert(std::make_pair(static_cast<size_t>(hash), page));
+  return page;
+}
+
+template<typename T>
+typename paged_table_t<T>::shared_page_t paged_table_t<T>::allocate_page(const page_t * const copy) const
+{
+  page_t *page = NULL;
+  
+  if(store)
+  {
+    assert(store->get_block_size() >= sizeof(page_t));
+    
+    void * const block = store->allocate();
+    if(!block)
+      return shared_page_t();
+    
+    page = copy ? new(block) page_t(*copy) : new(block) page_t;
+  }
+  else
+    page = copy ? new page_t(*copy) : new page_t;
+  
+  if(!copy)
+    std::fill(page->values, page->values + page_size, fill);
+  
+  if(store)
+  {
+    store_deleter_t deleter;
+    deleter.store = store;
+    return shared_page_t(page, deleter);
+  }
+  
+  return shared_page_t(page);
+}
+
+template<typename T>
+bool paged_table_t<T>::set_store(const std::shared_ptr<page_store_t> &store, moved_pages_t * const moved)
+{
+  if(this->store == store)
+    return true;
+  
+  this->store = store;
+  
+  ///pages shared in this table are only copied once
+  moved_pages_t local;
+  moved_pages_t &pages = moved ? *moved : local;
+  
+  for(size_t c = 0; c < chunks.size(); ++c)
+    if(chunks[c])
+    {
+      chunk_t &chunk = get_chunk(c);
+      for(size_t i = 0; i < chunk_size; ++i)
+        if(chunk.pages[i])
+        {
+          shared_page_t &copy = pages[chunk.pages[i].get()];
+          if(!copy)
+            copy = allocate_page(chunk.pages[i].get());
+          
+          ///store is full: remaining pages stay where they are
+          if(!copy)
+          {
+            pages.erase(chunk.pages[i].get());
+            return false;
+          }
+          
+          chunk.pages[i] = copy;
+        }
+    }
+  
+  return true;
+}
+
+template<typename T>
+bool paged_table_t<T>::set(const lid_t lid, const T &value, T * const previous)
+{
+  chunk_t &chunk = get_chunk(static_cast<size_t>(lid >> (page_bits + chunk_bits)));
+  
+  ///allocate a new page or copy a shared page (NULL page is filled)
+  shared_page_t &page = chunk.pages[(lid >> page_bits) & (chunk_size - 1)];
+  if(!page || !page.unique())
+  {
+    const shared_page_t copy = allocate_page(page.get());
+    if(!copy)
+      return false;
+    
+    page = copy;
+  }
+  
+  T &slot = page->values[lid & (page_size - 1)];
+  if(previous)
+    *previous = slot;
+  slot = value;
+  
+  if(lid >= lid_count)
+    lid_count = static_cast<size_t>(lid) + 1;
+  
+  return true;
+}
+
+template<typename T>
+bool paged_table_t<T>::set_page(const size_t index, const page_t &page)
+{
+  const shared_page_t copy = allocate_page(&page);
+  if(!copy)
+    return false;
+  
+  get_chunk(index >> chunk_bits).pages[index & (chunk_size - 1)] = copy;
+  
+  ///highest LID of page
+  for(size_t i = page_size; i > 0; --i)
+    if(!(page.values[i - 1] == fill))
+    {
+      lid_count = std::max(lid_count, (index << page_bits) + i);
+      break;
+    }
+  
+  return true;
+}
+
+template<typename T>
+bool paged_table_t<T>::is_fill(const page_t &page) const
+{
+  for(size_t i = 0; i < page_size; ++i)
+    if(!(page.values[i] == fill))
+      return false;
+  
+  return true;
+}
+
+template<typename T>
+size_t paged_table_t<T>::get_page_count() const
+{
+  size_t count = 0;
+  for(size_t i = next_page(0); i < get_directory_size(); i = next_page(i + 1))
+    ++count;
+  
+  return count;
+}
+
+template<typename T>
+void paged_table_t<T>::shrink()
+{
+  for(size_t c = 0; c < chunks.size(); ++c)
+  {
+    if(!chunks[c])
+      continue;
+    
+    chunk_t &chunk = get_chunk(c);
+    bool used = false;
+    for(size_t i = 0; i < chunk_size; ++i)
+    {
+      if(chunk.pages[i] && is_fill(*chunk.pages[i]))
+        chunk.pages[i].reset();
+      
+      used = used || chunk.pages[i];
+    }
+    
+    if(!used)
+      chunks[c].reset();
+  }
+  
+  ///Drop trailing unallocated chunks
+  size_t used = chunks.size();
+  while(used > 0 && !chunks[used - 1])
+    --used;
+  chunks.resize(used);
+  std::vector<shared_chunk_t>(chunks).swap(chunks);
+  
+  ///Drop trailing unallocated pages then trailing fill LIDs
+  size_t pages = get_directory_size();
+  while(pages > 0 && !get_page(pages - 1))
+    --pages;
+  
+  lid_count = std::min(lid_count, pages * page_size);
+  while(lid_count > 0 && find(lid_count - 1) == fill)
+    --lid_count;
+}
+
+template<typename T>
+void paged_table_t<T>::share(page_pool_t &pool)
+{
+  for(size_t c = 0; c < chunks.size(); ++c)
+    if(chunks[c])
+    {
+      chunk_t &chunk = get_chunk(c);
+      for(size_t i = 0; i < chunk_size; ++i)
+        if(chunk.pages[i])
+          chunk.pages[i] = pool.intern(chunk.pages[i]);
+    }
+}
+
+template<typename T>
+bool paged_table_t<T>::operator==(const paged_table_t &other) const
+{
+  const size_t count = std::max(chunks.size(), other.chunks.size());
+  
+  for(size_t c = 0; c < count; ++c)
+  {
+    const chunk_t * const ca = c < chunks.size() ? chunks[c].get() : NULL;
+    const chunk_t * const cb = c < other.chunks.size() ? other.chunks[c].get() : NULL;
+    
+    ///shared chunks hold the same pages
+    if(ca == cb)
+      continue;
+    
+    for(size_t i = 0; i < chunk_size; ++i)
+    {
+      const page_t * const a = ca ? ca->pages[i].get() : NULL;
+      const page_t * const b = cb ? cb->pages[i].get() : NULL;
+      
+      if(a == b)
+        continue;
+      
+      for(size_t j = 0; j < page_size; ++j)
+        if(!((a ? a->values[j] : fill) == (b ? b->values[j] : other.fill)))
+          return false;
+    }
+  }
+  
+  return true;
+}
+
+}
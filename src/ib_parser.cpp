@@ -32,9 +32,12 @@
 #include "regex.h"
 #include<cassert>
 #include<map>
+#include<deque>
 #include<sstream>
 #include<cstdlib>
 #include<cstdio>
+#include<algorithm>
+#include<thread>
 
 namespace infiniband {
 
@@ -83,7 +86,30 @@ port_type::type_t determine_ibnetdiscover_port_type(std::string type)
   return UNKNOWN;
 }
 
-bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, port_t *& port2)
+/**
+ * @brief allocate copy of port
+ * @param arena arena to allocate port in or NULL to use new
+ * @param port port to copy
+ * @return ptr to new port
+ */
+static port_t * create_port(port_arena_t * const arena, const port_t &port)
+{
+  return arena ? arena->create(port) : new port_t(port);
+}
+
+/**
+ * @brief release port from create_port()
+ * @param arena arena port was allocated in or NULL
+ * @param port port to release
+ */
+static void release_port(port_arena_t * const arena, port_t * const port)
+{
+  ///arena ports are only released with the arena
+  if(!arena)
+    delete port;
+}
+
+bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t &port1, port_t &port2, bool &cable)
 {
   regex::map::map_t results;
   
@@ -91,10 +117,8 @@ bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, por
   using regex::map::find_defined_int;
   using regex::map::find_defined_hex_int;
 
-  port1 = new port_t();
-  port2 = new port_t();
+  cable = false;
   
-  assert(port1); assert(port2);
   assert(ibnetdiscover_line_regex.ok());
   
   if(regex::match(line, ibnetdiscover_line_regex, results))
@@ -109,15 +133,20 @@ bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, por
     
     {
       std::string port_type;
+      std::string speed;
+      std::string width;
           
       if( ///Parse port1 properties
-        !find_defined_int(results, "HCA1_port", port1->port) ||
-        !find_defined_int(results, "HCA1_lid", port1->lid) ||
-        !find_defined_hex_int(results, "HCA1_guid", port1->guid) ||
+        !find_defined_int(results, "HCA1_port", port1.port) ||
+        !find_defined_int(results, "HCA1_lid", port1.lid) ||
+        !find_defined_hex_int(results, "HCA1_guid", port1.guid) ||
         !find_defined(results, "HCA1_type", port_type) ||
-        !find_defined(results, "speed", port1->speed) ||
-        !find_defined(results, "width", port1->width)
+        !find_defined(results, "speed", speed) ||
+        !find_defined(results, "width", width)
       ) return false;
+      
+      port1.speed = port_speed::from_string(speed);
+      port1.width = port_width::from_string(width);
 
       if(
         !find_defined(results, "HCA_name", label) && 
@@ -125,18 +154,18 @@ bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, por
       )
         return false;
       else 
-        if(!port1->parse(label))
+        if(!port1.parse(label))
           return false;
         
 #ifndef NDEBUG      
-      std::cout << label << " -> " << port1->label() << " guid:" << std::hex << port1->guid << std::endl;     
+      std::cout << label << " -> " << port1.label() << " guid:" << std::hex << port1.guid << std::endl;     
 #endif
       
       ///assume ibnetdiscover is correct
-      port1->type = determine_ibnetdiscover_port_type(port_type);
+      port1.type = determine_ibnetdiscover_port_type(port_type);
       ///port type shouldn't differ with parsed type 
-      //assert(port1->type == determine_ibnetdiscover_port_type(port_type));
-      assert(port1->type != port_type::UNKNOWN);
+      //assert(port1.type == determine_ibnetdiscover_port_type(port_type));
+      assert(port1.type != port_type::UNKNOWN);
     }
     
     if(find_defined(results, "HCA2_name", label))
@@ -144,27 +173,25 @@ bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, por
       std::string port_type;
       
       if( ///2 ports given (aka a lit cable)
-        !find_defined_int(results, "HCA2_port", port2->port) ||
-        !find_defined_int(results, "HCA2_lid", port2->lid) ||
-        !find_defined_hex_int(results, "HCA2_guid", port2->guid) ||
+        !find_defined_int(results, "HCA2_port", port2.port) ||
+        !find_defined_int(results, "HCA2_lid", port2.lid) ||
+        !find_defined_hex_int(results, "HCA2_guid", port2.guid) ||
         !find_defined(results, "HCA2_type", port_type) ||
-        !port2->parse(label)
+        !port2.parse(label)
       ) return false;
       
-      port2->type = determine_ibnetdiscover_port_type(port_type);
-      //assert(port2->type == determine_ibnetdiscover_port_type(port_type));
-      assert(port2->type != port_type::UNKNOWN);
-      port2->speed = port1->speed;
-      port2->width = port1->width;
+      cable = true;
+      port2.type = determine_ibnetdiscover_port_type(port_type);
+      //assert(port2.type == determine_ibnetdiscover_port_type(port_type));
+      assert(port2.type != port_type::UNKNOWN);
+      port2.speed = port1.speed;
+      port2.width = port1.width;
 #ifndef NDEBUG      
-      std::cout << label << " -> " << port2->label() << " guid:" << std::hex << port2->guid << std::endl;
+      std::cout << label << " -> " << port2.label() << " guid:" << std::hex << port2.guid << std::endl;
 #endif      
     }
     else ///port2 not given. no cable in port or it is dark
-    {
-      delete port2;
-      port2 = NULL;
-    }
+      cable = false;
     
     return true;
   }
@@ -176,9 +203,33 @@ bool ibnetdiscover_p_t::parse_line(const std::string &line, port_t *& port1, por
 }
 
 bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is) 
+{
+  return parse_ports(portmap, is, NULL);
+}
+
+bool ibnetdiscover_p_t::parse(fabric_t &fabric, std::istream &is) 
+{
+  portmap_t portmap;
+  port_arena_t &arena = fabric.get_port_arena();
+  const size_t mark = arena.get_mark();
+  
+  ///ports of a failed parse are never added to fabric
+  if(!parse_ports(portmap, is, &arena))
+  {
+    arena.release(mark);
+    return false;
+  }
+  
+  return fabric.add_cables(portmap);
+}
+
+bool ibnetdiscover_p_t::parse_ports(portmap_t &portmap, std::istream &is, port_arena_t * const arena) 
 {
   assert(portmap.empty());
   
+  ///hash index of portmap for lookups
+  guid_port_hash_t<port_t> porthash;
+  
 #ifndef NDEBUG
   size_t line_count = 0;
   size_t port_count = 0;
@@ -199,17 +250,19 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
     ++line_count;
 #endif
     
-    port_t* port1 = NULL;
-    port_t* port2 = NULL;
+    ///parse into temporary ports and only allocate unknown ports
+    port_t line_port1 = port_t();
+    port_t line_port2 = port_t();
+    bool cable = false;
     
-    if(!parse_line(line, port1, port2))
+    if(!parse_line(line, line_port1, line_port2, cable))
     {
       fail = true;
-      
-      delete port1;
-      delete port2;
       break;
     }
+    
+    port_t* port1 = &line_port1;
+    port_t* port2 = cable ? &line_port2 : NULL;
            
 #ifndef NDEBUG
     ///Make sure the search is working correctly
@@ -253,27 +306,35 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
     ///use the first instances
     bool found =  false;
     
-    if(portmap.find(port1) != portmap.end())
     {
-      port_t *port_ptr = port1;
-      port1 = portmap.at(port_ptr);
-      delete port_ptr;
-      found = true;
+      port_t * const known = porthash.find(port1->guid, port1->port);
+      if(known)
+      {
+        port1 = known;
+        found = true;
+      }
+      else ///port1 not seen yet
+      {
+        port1 = create_port(arena, line_port1);
+        portmap.insert(portmap_t::value_type(port1, port1));
+        porthash.insert(port1->guid, port1->port, port1);
+      }
     }
-    else ///port1 not seen yet
-      portmap.insert(portmap_t::value_type(port1, port1));
    
     if(port2)
     {
-      if(portmap.find(port2) != portmap.end())
+      port_t * const known = porthash.find(port2->guid, port2->port);
+      if(known)
       {
-        port_t *port_ptr = port2;
-        port2 = portmap.at(port_ptr);
-        delete port_ptr;
+        port2 = known;
         found = true;
       }
-      else ///port1 not seen yet
-        portmap.insert(portmap_t::value_type(port2, port2));   
+      else ///port2 not seen yet
+      {
+        port2 = create_port(arena, line_port2);
+        portmap.insert(portmap_t::value_type(port2, port2));
+        porthash.insert(port2->guid, port2->port, port2);
+      }
     }
     
     if(!found)
@@ -315,7 +376,318 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
   {
     ///release all ports instances
     for(portmap_t::iterator itr = portmap.begin(); itr != portmap.end(); ++itr)
-      delete itr->second;
+      release_port(arena, itr->second);
+   
+    portmap.clear();
+    
+    return false;
+  }
+  
+  return true;
+}
+
+/**
+ * @brief ibnetdiscover cache file magic number
+ */
+static const uint32_t ibnd_cache_magic = 0x8FE7832B;
+
+/**
+ * @brief ibnetdiscover cache record sizes
+ * @see IBND_FABRIC_CACHE_* in libibnetdisc/ibnetdisc_cache.c
+ */
+static const size_t ibnd_cache_header_len = 28;
+static const size_t ibnd_cache_node_len = 273;
+static const size_t ibnd_cache_node_port_len = 9;
+static const size_t ibnd_cache_port_len_v1 = 94;
+static const size_t ibnd_cache_port_len_v2 = 95;
+///IB_SMP_DATA_SIZE
+static const size_t ibnd_cache_smp_data_len = 64;
+
+/**
+ * @brief ibnetdiscover cache node types
+ * @see IB_NODE_* in infiniband/mad.h
+ */
+static const uint8_t ibnd_cache_node_ca = 1;
+static const uint8_t ibnd_cache_node_switch = 2;
+
+/**
+ * @brief offsets of fields in the PortInfo attribute
+ * @see IBA 14.2.5.6 PortInfo
+ */
+static const size_t portinfo_link_width_active = 31;
+static const size_t portinfo_link_speed_active = 35; ///upper nibble
+static const size_t portinfo_link_speed_ext_active = 62; ///upper nibble
+
+/**
+ * @brief unmarshall little endian integer from cache buffer
+ * @param buffer buffer to read from (will be advanced)
+ * @return integer
+ */
+template<typename T>
+static T unmarshall_cache_int(const unsigned char *&buffer)
+{
+  T value = 0;
+  for(size_t i = 0; i < sizeof(T); ++i)
+    value |= static_cast<T>(buffer[i]) << (8 * i);
+  buffer += sizeof(T);
+  return value;
+}
+
+/**
+ * @brief read exactly one cache record
+ * @param is stream to read from
+ * @param buffer buffer to fill
+ * @param length bytes to read
+ * @return true on success
+ */
+static bool read_cache_record(std::istream &is, std::vector<unsigned char> &buffer, const size_t length)
+{
+  buffer.resize(length);
+  is.read(reinterpret_cast<char *>(&buffer[0]), length);
+  return is && static_cast<size_t>(is.gcount()) == length;
+}
+
+/**
+ * @brief convert PortInfo LinkWidthActive to port width
+ */
+static port_width::width_t ibnd_cache_width(const uint8_t width)
+{
+  switch(width)
+  {
+    case 1: return port_width::X1;
+    case 2: return port_width::X4;
+    case 4: return port_width::X8;
+    case 8: return port_width::X12;
+    case 16: return port_width::X2;
+    default: return port_width::UNKNOWN;
+  }
+}
+
+/**
+ * @brief convert PortInfo LinkSpeed(Ext)Active to port speed
+ */
+static port_speed::speed_t ibnd_cache_speed(const uint8_t speed, const uint8_t espeed)
+{
+  switch(espeed)
+  {
+    case 1: return port_speed::FDR;
+    case 2: return port_speed::EDR;
+    case 4: return port_speed::HDR;
+    case 8: return port_speed::NDR;
+  }
+  
+  switch(speed)
+  {
+    case 1: return port_speed::SDR;
+    case 2: return port_speed::DDR;
+    case 4: return port_speed::QDR;
+    default: return port_speed::UNKNOWN;
+  }
+}
+
+bool ibnetdiscover_cache_t::parse(portmap_t &portmap, std::istream &is)
+{
+  return parse_ports(portmap, is, NULL);
+}
+
+bool ibnetdiscover_cache_t::parse_ports(portmap_t &portmap, std::istream &is, port_arena_t * const arena)
+{
+  assert(portmap.empty());
+  
+  /**
+   * Properties shared by every port of a node
+   * only the node description needs to be parsed and 
+   * it is done once per node instead of once per port
+   */
+  struct node_t {
+    port_type::type_t type;
+    lid_t smalid;
+    port_t properties;
+  };
+  typedef std::deque<node_t> nodes_t;
+  
+  /**
+   * Remote end of each port (cable) to connect 
+   * after all ports have been read
+   */
+  typedef std::vector<std::pair<port_t *, port_t::key_guid_port_t> > remotes_t;
+  
+  nodes_t nodes;
+  remotes_t remotes;
+  
+  ///hash index of nodes and portmap for lookups
+  guid_port_hash_t<const node_t> nodehash;
+  guid_port_hash_t<port_t> porthash;
+  std::vector<unsigned char> buffer;
+  
+  if(!is || !read_cache_record(is, buffer, ibnd_cache_header_len))
+  {
+    std::cerr << "Unable to read ibnetdiscover cache header" << std::endl;
+    return false;
+  }
+  
+  const unsigned char *ptr = &buffer[0];
+  const uint32_t magic = unmarshall_cache_int<uint32_t>(ptr);
+  const uint32_t version = unmarshall_cache_int<uint32_t>(ptr);
+  const uint32_t node_count = unmarshall_cache_int<uint32_t>(ptr);
+  const uint32_t port_count = unmarshall_cache_int<uint32_t>(ptr);
+  
+  if(magic != ibnd_cache_magic || (version != 1 && version != 2))
+  {
+    std::cerr << "Invalid ibnetdiscover cache magic: " << std::hex << magic << 
+      " version: " << version << std::dec << std::endl;
+    return false;
+  }
+  
+  const size_t port_len = version == 1 ? ibnd_cache_port_len_v1 : ibnd_cache_port_len_v2;
+  bool fail = false;
+  
+  for(uint32_t i = 0; !fail && i < node_count; ++i)
+  {
+    if(!read_cache_record(is, buffer, ibnd_cache_node_len))
+    {
+      fail = true;
+      break;
+    }
+    
+    ptr = &buffer[0];
+    node_t node = node_t();
+    node.smalid = unmarshall_cache_int<uint16_t>(ptr);
+    ptr += 2 + ibnd_cache_smp_data_len; ///smalmc, smaenhsp0, switchinfo
+    const guid_t guid = unmarshall_cache_int<uint64_t>(ptr);
+    const uint8_t type = unmarshall_cache_int<uint8_t>(ptr);
+    ptr += 1 + ibnd_cache_smp_data_len; ///numports, nodeinfo
+    
+    ///node description may not be null terminated
+    const char * const desc = reinterpret_cast<const char *>(ptr);
+    size_t desc_len = 0;
+    while(desc_len < ibnd_cache_smp_data_len && desc[desc_len])
+      ++desc_len;
+    ptr += ibnd_cache_smp_data_len + 1 + ibnd_cache_smp_data_len + 1; ///nodedesc, dr path, dist
+    const uint8_t stored_ports = unmarshall_cache_int<uint8_t>(ptr);
+    
+    if(type == ibnd_cache_node_ca)
+      node.type = port_type::HCA;
+    else if(type == ibnd_cache_node_switch)
+      node.type = port_type::TCA;
+    else
+    {
+      std::cerr << "Unsupported ibnetdiscover cache node type: " << regex::string_cast_uint(type) << std::endl;
+      fail = true;
+      break;
+    }
+    
+    if(!node.properties.parse(std::string(desc, desc_len)))
+    {
+      std::cerr << "Unable to parse node description: " << std::string(desc, desc_len) << std::endl;
+      fail = true;
+      break;
+    }
+    
+    ///Node port list is redundant with the port records
+    if(!read_cache_record(is, buffer, stored_ports * ibnd_cache_node_port_len))
+    {
+      fail = true;
+      break;
+    }
+    
+    ///first record of a node wins
+    if(!nodehash.find(guid))
+    {
+      nodes.push_back(node);
+      nodehash.insert(guid, 0, &nodes.back());
+    }
+  }
+  
+  for(uint32_t i = 0; !fail && i < port_count; ++i)
+  {
+    if(!read_cache_record(is, buffer, port_len))
+    {
+      fail = true;
+      break;
+    }
+    
+    ptr = &buffer[0];
+    const guid_t guid = unmarshall_cache_int<uint64_t>(ptr);
+    const port_num_t port_num = unmarshall_cache_int<uint8_t>(ptr);
+    if(version > 1)
+      ++ptr; ///external port num
+    const lid_t base_lid = unmarshall_cache_int<uint16_t>(ptr);
+    ++ptr; ///lmc
+    const unsigned char * const info = ptr;
+    ptr += ibnd_cache_smp_data_len;
+    const guid_t node_guid = unmarshall_cache_int<uint64_t>(ptr);
+    const uint8_t remote_flag = unmarshall_cache_int<uint8_t>(ptr);
+    const guid_t remote_guid = unmarshall_cache_int<uint64_t>(ptr);
+    const port_num_t remote_port_num = unmarshall_cache_int<uint8_t>(ptr);
+    
+    ///Switch management port is never listed by 'ibnetdiscover -p'
+    if(port_num == 0)
+      continue;
+    
+    const node_t * const node_ptr = nodehash.find(node_guid);
+    if(!node_ptr)
+    {
+      std::cerr << "Port " << std::hex << guid << std::dec << " has unknown node" << std::endl;
+      fail = true;
+      break;
+    }
+    const node_t &node = *node_ptr;
+    
+    if(!guid || porthash.find(guid, port_num))
+    {
+      std::cerr << "Invalid or duplicate port " << std::hex << guid << std::dec << 
+        "/" << regex::string_cast_uint(port_num) << std::endl;
+      fail = true;
+      break;
+    }
+    
+    port_t *port = create_port(arena, node.properties);
+    port->guid = guid;
+    port->port = port_num;
+    port->type = node.type;
+    ///ibnetdiscover always gives switch lid for switch ports
+    port->lid = node.type == port_type::TCA ? node.smalid : base_lid;
+    port->width = ibnd_cache_width(info[portinfo_link_width_active]);
+    port->speed = ibnd_cache_speed(
+      info[portinfo_link_speed_active] >> 4, 
+      info[portinfo_link_speed_ext_active] >> 4
+    );
+    port->connection = NULL;
+    
+    portmap.insert(portmap_t::value_type(port, port));
+    porthash.insert(guid, port_num, port);
+    
+    if(remote_flag && remote_guid && remote_port_num)
+      remotes.push_back(remotes_t::value_type(port, port_t::key_guid_port_t(remote_guid, remote_port_num)));
+  }
+  
+  if(!fail)
+    for(remotes_t::const_iterator itr = remotes.begin(); itr != remotes.end(); ++itr)
+    {
+      port_t * const remote = porthash.find(itr->second.guid, itr->second.port);
+      
+      ///cable to port that was never cached is treated as dark
+      if(!remote)
+        continue;
+      
+      port_t * const port1 = itr->first;
+      port_t * const port2 = remote;
+      
+      ///both ends of a cable are given
+      assert(port1->connection == NULL || port1->connection == port2);
+      port1->connection = port2;
+      port2->connection = port1;
+    }
+  
+  ///Cleanup memory on failure
+  if(fail)
+  {
+    std::cerr << "Unable to parse ibnetdiscover cache" << std::endl;
+    
+    ///release all ports instances
+    for(portmap_t::iterator itr = portmap.begin(); itr != portmap.end(); ++itr)
+      release_port(arena, itr->second);
    
     portmap.clear();
     
@@ -325,6 +697,22 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
   return true;
 }
 
+bool ibnetdiscover_cache_t::parse(fabric_t &fabric, std::istream &is)
+{
+  portmap_t portmap;
+  port_arena_t &arena = fabric.get_port_arena();
+  const size_t mark = arena.get_mark();
+  
+  ///ports of a failed parse are never added to fabric
+  if(!parse_ports(portmap, is, &arena))
+  {
+    arena.release(mark);
+    return false;
+  }
+  
+  return fabric.add_cables(portmap);
+}
+
 /**
  * @brief regex to read single line of ibdiagnet4.fdbs 
  * @example input example:
@@ -340,6 +728,9 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
  *  0x0008 : 002  : 00   : yes
  *  0x0009 : 005  : 00   : yes
  *  0x000a : 005  : 00   : yes
+ *  PLFT_NUM: 1
+ *  LID    : Port : Hops : Optimal
+ *  0x0002 : 004  : 00   : yes
  * 
  * @note hops and optimal are ignored
  *  no examples have been observed where they change
@@ -347,7 +738,10 @@ bool ibnetdiscover_p_t::parse(portmap_t &portmap, std::istream &is)
 static re2::RE2 ibdiagnet_fwd_db_line_regex(
   "^"
   "(?:"
-      "#|$|LID|PLFT_NUM: 0" ///Ignore comments and empty lines and headers
+      "#|$|LID" ///Ignore comments and empty lines and headers
+    "|"
+      ///Start new PLFT of current switch
+      "PLFT_NUM:\\s*(?P<plft>[0-9]+)"
     "|"
       ///Start new switch stanza
       "osm_ucast_mgr_dump_ucast_routes:\\s"
@@ -389,6 +783,11 @@ bool ibdiagnet_fwd_db::parse(fabric_t& fabric, std::istream& is)
    */
   guid_t guid = 0;
   
+  /**
+   * PLFT currently being read (reset by every switch)
+   */
+  plft_num_t plft = 0;
+  
   while(!fail && is && std::getline(is, line))
   {
     regex::map::map_t results;
@@ -409,7 +808,15 @@ bool ibdiagnet_fwd_db::parse(fabric_t& fabric, std::istream& is)
       if(find_defined_hex_int(results, "switch", guid))
         std::cout << "switch: " << guid << std::endl;
 #endif        
-      if(!find_defined_hex_int(results, "switch", guid))
+      if(find_defined_hex_int(results, "switch", guid))
+        plft = 0;
+      else if(find_defined_int(results, "plft", plft))
+      {
+#ifndef NDEBUG
+        std::cout << "plft: " << regex::string_cast_uint(plft) << std::endl;
+#endif
+      }
+      else
       {
         lid_t lid = 0;
         port_num_t port = 0;
@@ -427,7 +834,7 @@ bool ibdiagnet_fwd_db::parse(fabric_t& fabric, std::istream& is)
 #ifndef NDEBUG 
           std::cout << "route=  port:" << regex::string_cast_uint(port)  << " lid: " << regex::string_cast_uint(lid) << std::endl;
 #endif 
-          if(!fabric.add_route(guid, port, lid))
+          if(!fabric.add_route(guid, port, lid, plft))
             return false;
         }
       }
@@ -442,6 +849,793 @@ bool ibdiagnet_fwd_db::parse(fabric_t& fabric, std::istream& is)
   return true;
 }
 
+/**
+ * @brief regex to read single line of ibdiagnet2.mcfdbs 
+ * @example input example:
+ *  Switch 0x0002c9030068ec10
+ *  LID    : Out Port(s)
+ *  0xc000 : 0x001 0x002 0x011
+ *  0xc001 : 0x003
+ * 
+ * @note opensm style 'osm_mcast_mgr_dump_mcast_routes: Switch' headers 
+ *  and decimal port numbers are also accepted
+ */
+static re2::RE2 ibdiagnet_mcast_fwd_db_line_regex(
+  "^"
+  "(?:"
+      "#|$|LID|PLFT_NUM" ///Ignore comments and empty lines and headers
+    "|"
+      ///Start new switch stanza
+      "(?:osm_mcast_mgr_dump_mcast_routes:\\s|)"
+      "Switch\\s"
+      "(?P<switch>0x[a-zA-Z0-9]+)" ///switch GUID
+    "|"
+      ///MLID and every output port
+      "(?P<mlid>0x[a-zA-Z0-9]+)"  ///hex MLID
+      "\\s+:"
+      "(?P<ports>(?:\\s+(?:0x[a-fA-F0-9]+|[0-9]+))*)" ///output ports
+      "\\s*$"
+  ")"
+);
 
-}}
+bool ibdiagnet_mcast_fwd_db::parse(fabric_t& fabric, std::istream& is)
+{
+  assert(fabric.get_entities().size());
+  assert(ibdiagnet_mcast_fwd_db_line_regex.ok());
+  
+  using regex::map::find_defined;
+  using regex::map::find_defined_hex_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is)
+    return false;
+  
+  std::string line;
+  regex::map::map_t results;
+  
+  /**
+   * Every switch is given by GUID
+   * remember guid since it is not given every line
+   */
+  guid_t guid = 0;
+  
+  while(is && std::getline(is, line))
+  {
+    if(!regex::match(line, ibdiagnet_mcast_fwd_db_line_regex, results))
+    {
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+    
+    if(find_defined_hex_int(results, "switch", guid))
+      continue;
+    
+    lid_t mlid = 0;
+    if(!find_defined_hex_int(results, "mlid", mlid))
+      continue;
+    
+    if(!guid)
+    {
+      std::cerr << "MLID given before switch: "<< line << std::endl;
+      return false;
+    }
+    
+    std::string ports;
+    find_defined(results, "ports", ports);
+    
+    std::istringstream ss(ports);
+    std::string token;
+    while(ss >> token)
+    {
+      const port_num_t port = token.compare(0, 2, "0x") == 0 ?
+        regex::uint_cast_hex_string<port_num_t>(token) :
+        regex::uint_cast_string<port_num_t>(token);
+        
+#ifndef NDEBUG 
+      std::cout << "mcast route= switch: " << std::hex << guid << " mlid: " << mlid << std::dec << 
+        " port:" << regex::string_cast_uint(port) << std::endl;
+#endif 
+      
+      if(!fabric.add_multicast_route(guid, mlid, port))
+        return false;
+    }
+  }
+  
+  return true;
+}
 
+/**
+ * @brief regex to read single line of ibdiagnet2.ar
+ * @example input example:
+ *  Switch 0x0002c9030068ec10
+ *  Group  : Port(s)
+ *  0x0001 : 0x011 0x012 0x013 0x014
+ *  0x0002 : 0x001 0x002
+ *  LID    : Group
+ *  0x0003 : 0x0001
+ *  0x0004 : 0x0001
+ *  PLFT_NUM: 1
+ *  LID    : Group
+ *  0x0003 : 0x0002
+ * 
+ * @note every line after a 'Group' header gives a group and its ports
+ *  and every line after a 'LID' header gives a lid and its group in 
+ *  the current PLFT (0 until a 'PLFT_NUM' line). Groups are shared by 
+ *  every PLFT. decimal port and group numbers are also accepted
+ */
+static re2::RE2 ibdiagnet_ar_line_regex(
+  "^"
+  "(?:"
+      "#|$" ///Ignore comments and empty lines
+    "|"
+      ///Start new PLFT of current switch
+      "PLFT_NUM:\\s*(?P<plft>[0-9]+)"
+    "|"
+      ///Start new table section
+      "(?P<section>Group|LID)\\b.*"
+    "|"
+      ///Start new switch stanza
+      "(?:dump_ar:\\s|)"
+      "Switch\\s"
+      "(?P<switch>0x[a-zA-Z0-9]+)" ///switch GUID
+    "|"
+      ///group or LID and its values
+      "(?P<key>0x[a-fA-F0-9]+|[0-9]+)"  ///group or LID
+      "\\s+:"
+      "(?P<values>(?:\\s+(?:0x[a-fA-F0-9]+|[0-9]+))*)" ///ports or group
+      "\\s*$"
+  ")"
+);
+
+/**
+ * @brief cast hex (0x prefixed) or decimal string to int
+ */
+template<typename T>
+static T ibdiagnet_ar_cast(const std::string &token)
+{
+  return token.compare(0, 2, "0x") == 0 ?
+    regex::uint_cast_hex_string<T>(token) :
+    regex::uint_cast_string<T>(token);
+}
+
+bool ibdiagnet_ar::parse(fabric_t& fabric, std::istream& is)
+{
+  assert(fabric.get_entities().size());
+  assert(ibdiagnet_ar_line_regex.ok());
+  
+  typedef adaptive_routing_table_t::group_t group_t;
+  
+  using regex::map::find_defined;
+  using regex::map::find_defined_hex_int;
+  using regex::map::find_defined_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is)
+    return false;
+  
+  std::string line;
+  regex::map::map_t results;
+  
+  /**
+   * Every switch is given by GUID
+   * remember guid and section since they are not given every line
+   */
+  guid_t guid = 0;
+  plft_num_t plft = 0;
+  std::string section;
+  
+  while(is && std::getline(is, line))
+  {
+    if(!regex::match(line, ibdiagnet_ar_line_regex, results))
+    {
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+    
+    if(find_defined_hex_int(results, "switch", guid))
+    {
+      plft = 0;
+      section.clear();
+      continue;
+    }
+    
+    if(find_defined_int(results, "plft", plft))
+    {
+      if(!guid)
+      {
+        std::cerr << "PLFT given before switch: "<< line << std::endl;
+        return false;
+      }
+      
+      section.clear();
+      continue;
+    }
+    
+    if(find_defined(results, "section", section))
+      continue;
+    
+    std::string key;
+    if(!find_defined(results, "key", key))
+      continue;
+    
+    if(!guid || section.empty())
+    {
+      std::cerr << "AR table given before switch: "<< line << std::endl;
+      return false;
+    }
+    
+    std::string values;
+    find_defined(results, "values", values);
+    
+    std::istringstream ss(values);
+    std::string token;
+    
+    if(section == "LID")
+    {
+      const lid_t lid = ibdiagnet_ar_cast<lid_t>(key);
+      if(!(ss >> token) || !lid)
+      {
+        std::cerr << "Unable to parse: "<< line << std::endl;
+        return false;
+      }
+      
+#ifndef NDEBUG 
+      std::cout << "ar lid= switch: " << std::hex << guid << " lid: " << lid << " group: " << token << std::dec << 
+        " plft: " << regex::string_cast_uint(plft) << std::endl;
+#endif 
+      
+      if(!fabric.set_adaptive_route_group(guid, lid, ibdiagnet_ar_cast<group_t>(token), plft))
+        return false;
+      
+      continue;
+    }
+    
+    const group_t group = ibdiagnet_ar_cast<group_t>(key);
+    while(ss >> token)
+    {
+      const port_num_t port = ibdiagnet_ar_cast<port_num_t>(token);
+        
+#ifndef NDEBUG 
+      std::cout << "ar group= switch: " << std::hex << guid << " group: " << group << std::dec << 
+        " port:" << regex::string_cast_uint(port) << std::endl;
+#endif 
+      
+      if(!fabric.add_adaptive_route(guid, group, port))
+        return false;
+    }
+  }
+  
+  return true;
+}
+
+/**
+ * @brief regex to read single line of ibdiagnet2.sl2vl
+ * @example input example:
+ *  # This database file was automatically generated by IBDIAG
+ *  0x0002c903006e1430 in:1 out:2 sl2vl: 0x01 0x23 0x45 0x67 0x01 0x23 0x45 0x60
+ *  0x0002c903006e1430 1 3 0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 0
+ * 
+ * @note VLs are given either as 8 bytes of 2 packed VLs (SL0 in high nibble of first byte)
+ *  or as 16 VL values in SL order
+ */
+static re2::RE2 ibdiagnet_sl2vl_line_regex(
+  "^\\s*"
+  "(?:"
+      "#|$" ///Ignore comments and empty lines
+    "|"
+      "(?P<guid>0x[a-fA-F0-9]+)\\s+"       ///entity GUID
+      "(?:in:|)(?P<in>[0-9]+)\\s+"         ///ingress port
+      "(?:out:|)(?P<out>[0-9]+)\\s+"       ///egress port
+      "(?:sl2vl:\\s*|:\\s*|)"
+      "(?P<vls>"
+          "(?:0x[a-fA-F0-9]{1,2}(?:\\s+|$)){8}"  ///packed VLs
+        "|"
+          "(?:[0-9]{1,2}(?:\\s+|$)){16}"         ///VL per SL
+      ")"
+      "\\s*$"
+  ")"
+);
+
+bool ibdiagnet_sl2vl::parse(fabric_t& fabric, std::istream& is)
+{
+  assert(fabric.get_entities().size());
+  assert(ibdiagnet_sl2vl_line_regex.ok());
+  
+  typedef sl2vl_tables_t::sl2vl_t sl2vl_t;
+  
+  using regex::map::find_defined;
+  using regex::map::find_defined_int;
+  using regex::map::find_defined_hex_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is)
+    return false;
+  
+  std::string line;
+  regex::map::map_t results;
+  
+  ///tables are compacted once every table of entity is given
+  guid_t last_guid = 0;
+  
+  while(is && std::getline(is, line))
+  {
+    guid_t guid = 0;
+    port_num_t in = 0;
+    port_num_t out = 0;
+    std::string vls;
+    
+    if(!regex::match(line, ibdiagnet_sl2vl_line_regex, results))
+    {
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+    
+    if(
+      !find_defined_hex_int(results, "guid", guid) ||
+      !find_defined_int(results, "in", in) ||
+      !find_defined_int(results, "out", out) ||
+      !find_defined(results, "vls", vls)
+    )
+      continue; ///comment
+    
+    std::vector<unsigned int> values;
+    {
+      std::istringstream ss(vls);
+      std::string token;
+      while(ss >> token)
+        values.push_back(
+          token.compare(0, 2, "0x") == 0 ?
+            regex::uint_cast_hex_string<unsigned int>(token) :
+            regex::uint_cast_string<unsigned int>(token)
+        );
+    }
+    
+    sl2vl_t table = 0;
+    if(values.size() == SL_COUNT / 2)
+    {
+      for(sl_t i = 0; i < SL_COUNT / 2; ++i)
+      {
+        table = sl2vl_tables_t::set_vl(table, 2 * i, values[i] >> 4);
+        table = sl2vl_tables_t::set_vl(table, 2 * i + 1, values[i] & 0xF);
+      }
+    }
+    else
+    {
+      assert(values.size() == SL_COUNT);
+      for(sl_t i = 0; i < SL_COUNT; ++i)
+        if(values[i] > 0xF)
+        {
+          std::cerr << "Invalid VL: "<< line << std::endl;
+          return false;
+        }
+        else
+          table = sl2vl_tables_t::set_vl(table, i, values[i]);
+    }
+    
+    if(last_guid && last_guid != guid && !fabric.compact_sl2vl(last_guid))
+      return false;
+    last_guid = guid;
+    
+    if(!fabric.add_sl2vl(guid, in, out, table))
+    {
+      std::cerr << "Unknown entity: "<< line << std::endl;
+      return false;
+    }
+  }
+  
+  return !last_guid || fabric.compact_sl2vl(last_guid);
+}
+
+/**
+ * @brief regex to read single line of ibdiagnet2.pkey
+ * @example input example:
+ *  Port Name=ys0101 HCA-1/P1, Lid=0x0010, GUID=0x0002c9030045f121, Port Number=1
+ *  -------------------------------------------------------
+ *  Block Index=0, pkey idx=0, Membership=Full, P_Key=0x7fff
+ *  Block Index=0, pkey idx=1, Membership=Limited, P_Key=0x0003
+ * 
+ * @note Membership is optional, otherwise pkey high bit gives membership
+ */
+static re2::RE2 ibdiagnet_pkey_line_regex(
+  "^\\s*"
+  "(?:"
+      "#|-*$" ///Ignore comments, empty lines and separators
+    "|"
+      ///Start new port stanza
+      "Port\\s+Name=.*?"
+      "GUID=(?P<guid>0x[a-fA-F0-9]+),\\s*"   ///port GUID
+      "Port\\s+Number=(?P<port>[0-9]+)"      ///port number
+    "|"
+      ///pkey table entry
+      ".*?"
+      "(?:Membership=(?P<membership>Full|Limited|0x[0-9a-fA-F]+),\\s*|)"
+      "P_?Key=(?P<pkey>0x[a-fA-F0-9]+)"      ///pkey
+  ")"
+);
+
+bool ibdiagnet_pkey::parse(fabric_t& fabric, std::istream& is)
+{
+  assert(fabric.get_portmap().size());
+  assert(ibdiagnet_pkey_line_regex.ok());
+  
+  using regex::map::find_defined;
+  using regex::map::find_defined_int;
+  using regex::map::find_defined_hex_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is)
+    return false;
+  
+  std::string line;
+  regex::map::map_t results;
+  
+  /**
+   * Every port is given by GUID and port number
+   * remember port since it is not given every line
+   */
+  guid_t guid = 0;
+  port_num_t port = 0;
+  bool port_seen = false;
+  
+  ///ports missing from the fabric are only reported once
+  size_t unknown_pkeys = 0;
+  guid_t unknown_guid = 0;
+  port_num_t unknown_port = 0;
+  
+  while(is && std::getline(is, line))
+  {
+    if(!regex::match(line, ibdiagnet_pkey_line_regex, results))
+    {
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+    
+    if(find_defined_hex_int(results, "guid", guid))
+    {
+      if(!find_defined_int(results, "port", port))
+        return false;
+      
+      port_seen = true;
+      continue;
+    }
+    
+    pkey_t pkey = 0;
+    if(!find_defined_hex_int(results, "pkey", pkey))
+      continue;
+    
+    if(!port_seen)
+    {
+      std::cerr << "pkey given before port: "<< line << std::endl;
+      return false;
+    }
+    
+    ///switch management port 0 is not part of the fabric ports
+    if(!port)
+      continue;
+    
+    ///Explicit membership overrides pkey membership bit
+    std::string membership;
+    if(find_defined(results, "membership", membership))
+    {
+      if(membership == "Full" || (membership.compare(0, 2, "0x") == 0 && regex::uint_cast_hex_string<unsigned int>(membership)))
+        pkey |= PKEY_FULL_MEMBER;
+      else
+        pkey &= PKEY_BASE_MASK;
+    }
+    
+#ifndef NDEBUG 
+    std::cout << "pkey: " << std::hex << guid << std::dec << "/" << regex::string_cast_uint(port) << 
+      " = " << std::hex << pkey << std::dec << std::endl;
+#endif 
+    
+    if(!fabric.add_pkey(guid, port, pkey) && !unknown_pkeys++)
+    {
+      unknown_guid = guid;
+      unknown_port = port;
+    }
+  }
+  
+  if(unknown_pkeys)
+    std::cerr << "Skipped " << unknown_pkeys << " pkeys of unknown ports (first " << 
+      std::hex << unknown_guid << std::dec << "/" << regex::string_cast_uint(unknown_port) << ")" << std::endl;
+  
+  return true;
+}
+
+/**
+ * @brief regex to read single line of ibroute/dump_lfts.sh/opensm-lfts.dump
+ * @example input example:
+ *  Unicast lids [0x0-0x8] of switch Lid 2 guid 0x0002c90200400098 (MT47396 Infiniscale-III Mellanox Technologies):
+ *    Lid  Out   Destination
+ *         Port     Info 
+ *  0x0001 001 : (Channel Adapter portguid 0x0002c9020025874a: 'HCA-1')
+ *  0x0002 000 : (Switch portguid 0x0002c90200400098: 'MT47396 Infiniscale-III Mellanox Technologies')
+ *  2 valid lids dumped 
+ * 
+ * @note destination info is ignored
+ */
+static re2::RE2 dump_lfts_line_regex(
+  "^\\s*"
+  "(?:"
+      "#|$|Lid\\s|Port\\s|\\d+\\s+(?:valid\\s+|)lids\\s+dumped" ///Ignore comments and empty lines and headers
+    "|"
+      ///Start new switch block
+      "Unicast\\s+lids\\s+\\[0x[a-fA-F0-9]+-0x[a-fA-F0-9]+\\]\\s+"
+      "of\\s+switch\\s+.*"
+      "guid\\s+(?P<switch>0x[a-fA-F0-9]+)" ///switch GUID
+    "|"
+      ///lid + port
+      "(?P<lid>0x[a-fA-F0-9]+)"  ///hex LID
+      "\\s+"
+      "(?P<port>[0-9]+)" ///output port number
+      "(?:\\s|$)"
+  ")"
+);
+
+/**
+ * @brief max number of switch blocks held in memory per thread
+ */
+static const size_t dump_lfts_blocks_per_thread = 16;
+
+void dump_lfts_t::parse_block(block_t &block)
+{
+  using regex::map::find_defined_int;
+  using regex::map::find_defined_hex_int;
+  
+  regex::map::map_t results;
+  block.routes.reserve(block.lines.size());
+  
+  for(
+    std::vector<std::string>::const_iterator 
+      itr = block.lines.begin(),
+      eitr = block.lines.end();
+    itr != eitr;
+    ++itr
+  )
+  {
+    lid_t lid = 0;
+    port_num_t port = 0;
+    
+    if(!regex::match(*itr, dump_lfts_line_regex, results))
+    {
+      block.fail = true;
+      return;
+    }
+    
+    if( ///line could be a lid+port 
+      find_defined_hex_int(results, "lid", lid) &&
+      find_defined_int(results, "port", port) &&
+      port != 0 ///if route port = 0, then route points to this guid's managment port
+    )
+    {
+      assert(lid > 0);
+      block.routes.push_back(std::make_pair(lid, port));
+    }
+  }
+}
+
+bool dump_lfts_t::flush(fabric_t &fabric, blocks_t &blocks)
+{
+  const size_t thread_count = std::min(
+    blocks.size(), 
+    static_cast<size_t>(std::max(1U, std::thread::hardware_concurrency()))
+  );
+  std::vector<std::thread> threads;
+  
+  ///Each thread takes every Nth block
+  for(size_t i = 1; i < thread_count; ++i)
+    threads.push_back(std::thread([&blocks, i, thread_count]() {
+      for(size_t j = i; j < blocks.size(); j += thread_count)
+        parse_block(blocks[j]);
+    }));
+  
+  for(size_t j = 0; j < blocks.size(); j += std::max<size_t>(1, thread_count))
+    parse_block(blocks[j]);
+  
+  for(size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  
+  ///Only add routes in file order once every block is parsed 
+  for(blocks_t::const_iterator itr = blocks.begin(); itr != blocks.end(); ++itr)
+  {
+    if(itr->fail)
+    {
+      std::cerr << "Unable to parse LFT block of switch: " << std::hex << itr->guid << std::dec << std::endl;
+      return false;
+    }
+    
+#ifndef NDEBUG
+    std::cout << "switch: " << itr->guid << " routes: " << itr->routes.size() << std::endl;
+#endif
+    
+    for(
+      std::vector<std::pair<lid_t, port_num_t> >::const_iterator 
+        ritr = itr->routes.begin(),
+        reitr = itr->routes.end();
+      ritr != reitr;
+      ++ritr
+    )
+      if(!fabric.add_route(itr->guid, ritr->second, ritr->first))
+        return false;
+  }
+  
+  blocks.clear();
+  return true;
+}
+
+bool dump_lfts_t::parse(fabric_t& fabric, std::istream& is)
+{
+  assert(fabric.get_portmap().size());
+  assert(fabric.get_entities().size());
+  assert(dump_lfts_line_regex.ok());
+  
+  using regex::map::find_defined_hex_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is)
+    return false;
+  
+  const size_t max_blocks = dump_lfts_blocks_per_thread * 
+    std::max(1U, std::thread::hardware_concurrency());
+  
+  blocks_t blocks;
+  std::string line;
+  regex::map::map_t results;
+  
+  while(is && std::getline(is, line))
+  {
+    guid_t guid = 0;
+    
+    /**
+     * Only the block headers are matched here
+     * every other line is parsed by the block
+     */
+    if(line.find("Unicast") != std::string::npos)
+    {
+      if(
+        !regex::match(line, dump_lfts_line_regex, results) ||
+        !find_defined_hex_int(results, "switch", guid)
+      )
+      {
+        std::cerr << "Unable to parse: "<< line << std::endl;
+        return false;
+      }
+      
+      if(blocks.size() >= max_blocks && !flush(fabric, blocks))
+        return false;
+      
+      assert(guid > 0);
+      blocks.push_back(block_t());
+      blocks.back().guid = guid;
+      blocks.back().fail = false;
+    }
+    else if(!blocks.empty())
+      blocks.back().lines.push_back(line);
+    else if(!regex::match(line, dump_lfts_line_regex, results) || results["lid"].size())
+    {
+      ///routes given before any switch 
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+  }
+  
+  return flush(fabric, blocks);
+}
+
+/**
+ * @brief regex to read single line of ibdiagnet2.lst
+ * @example input example:
+ *  { CA Ports:1 SystemGUID:0002c90300a3d7c3 NodeGUID:0002c90300a3d7c0 PortGUID:0002c90300a3d7c1 VenID:000002C9 DevID:1003 Rev:00000001 {ys0101 HCA-1} LID:0001 PN:01 } { SW Ports:24 SystemGUID:0008f10500201c2e NodeGUID:0008f10500201c2c PortGUID:0008f10500201c2c VenID:000008F1 DevID:5A5A Rev:000000A1 {MF0;ys01ib1:IS5030/U1} LID:0002 PN:0F } PHY=4x LOG=ACT SPD=10
+ * 
+ * @note all values are hex without 0x prefix
+ * @note LMC field is optional
+ */
+static re2::RE2 ibdiagnet_lst_line_regex(
+  "^\\s*"
+  "(?:"
+      "#|$" ///Ignore comments and empty lines
+    "|"
+      "\\{\\s*"
+        "(?P<type1>CA|SW)\\s+"                         ///port1 type
+        ".*?"
+        "PortGUID:(?P<guid1>[0-9a-fA-F]+)\\s+"         ///port1 GUID
+        ".*?"
+        "LID:(?P<lid1>[0-9a-fA-F]+)\\s+"               ///port1 LID
+        "PN:(?P<port1>[0-9a-fA-F]+)"                   ///port1 number
+        "(?:\\s+LMC:(?P<lmc1>[0-9]+)|)"                ///port1 LMC
+      "\\s*\\}\\s*"
+      "\\{\\s*"
+        "(?P<type2>CA|SW)\\s+"                         ///port2 type
+        ".*?"
+        "PortGUID:(?P<guid2>[0-9a-fA-F]+)\\s+"         ///port2 GUID
+        ".*?"
+        "LID:(?P<lid2>[0-9a-fA-F]+)\\s+"               ///port2 LID
+        "PN:(?P<port2>[0-9a-fA-F]+)"                   ///port2 number
+        "(?:\\s+LMC:(?P<lmc2>[0-9]+)|)"                ///port2 LMC
+      "\\s*\\}"
+  ")"
+);
+
+bool ibdiagnet_lst::parse(fabric_t& fabric, std::istream& is, const lmc_t lmc)
+{
+  assert(fabric.get_portmap().size());
+  assert(ibdiagnet_lst_line_regex.ok());
+  
+  using regex::map::find_defined;
+  using regex::map::find_defined_int;
+  using regex::map::find_defined_hex_int;
+  
+  /**
+   * Make sure the stream is good to start with
+   */
+  if(!is || lmc > MAX_LMC_VALUE)
+    return false;
+  
+  std::string line;
+  regex::map::map_t results;
+  
+  while(is && std::getline(is, line))
+  {
+    if(!regex::match(line, ibdiagnet_lst_line_regex, results))
+    {
+      std::cerr << "Unable to parse: "<< line << std::endl;
+      return false;
+    }
+    
+    ///Each line gives both ports of a link
+    static const char * const suffixes[] = { "1", "2" };
+    for(size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i)
+    {
+      const std::string suffix = suffixes[i];
+      std::string type;
+      guid_t guid = 0;
+      lid_t lid = 0;
+      port_num_t port = 0;
+      
+      if(!find_defined(results, "type" + suffix, type))
+        break; ///comment or empty line
+      
+      if(
+        !find_defined_hex_int(results, "guid" + suffix, guid) ||
+        !find_defined_hex_int(results, "lid" + suffix, lid) ||
+        !find_defined_hex_int(results, "port" + suffix, port)
+      )
+      {
+        std::cerr << "Unable to parse: "<< line << std::endl;
+        return false;
+      }
+      
+      ///Only HCAs get the subnet lmc
+      lmc_t port_lmc = type == "CA" ? lmc : 0;
+      find_defined_int(results, "lmc" + suffix, port_lmc);
+      
+#ifndef NDEBUG 
+      std::cout << "port: " << std::hex << guid << std::dec << "/" << regex::string_cast_uint(port) << 
+        " lid: " << lid << " lmc: " << regex::string_cast_uint(port_lmc) << std::endl;
+#endif 
+      
+      if(!lid) ///port without lid is not active
+        continue;
+      
+      if(!fabric.set_port_lid(guid, port, lid, port_lmc))
+      {
+        std::cerr << "Unknown port or invalid lmc: "<< line << std::endl;
+        return false;
+      }
+    }
+  }
+  
+  return true;
+}
+
+}}
@@ -65,28 +65,94 @@ public:
    * @return true on success
    * @warning portmap should always be empty when given to this function
    * @warning source file doesn't specify LMC value of network or give lids for LMC>0
+   * @see ibdiagnet_lst to give exact port lids
    */
   bool parse(portmap_t &portmap, std::istream &is); 
   
+  /**
+   * @brief parse input stream and add every cable to fabric
+   * @param fabric fabric to populate (should be empty)
+   * @param is input stream to parse
+   * @return true on success
+   * @note ports are allocated in the fabric port arena (released again if parsing fails)
+   */
+  bool parse(fabric_t &fabric, std::istream &is);
+  
 private:
   
+  /**
+   * @brief parse input stream into port map
+   * @param portmap port map to fill with port ptrs
+   * @param is input stream to parse
+   * @param arena arena to allocate ports in (portmap owns ports allocated with new if NULL)
+   * @return true on success
+   */
+  bool parse_ports(portmap_t &portmap, std::istream &is, port_arena_t * const arena);
+  
   /** 
   * @brief ibnetdiscover line struct
   * class to hold contents of one line from 'ibnetdiscover -p'
   * @param line string containing line to parse
-  * @param port1 reference to pointer to assign a port_t object
-  * passes ownership of port1 instance
-  * @param port2 reference to pointer to assign a port_t object, can be null
-  * passes ownership of port2 instance
+  * @param port1 port to fill with first port
+  * @param port2 port to fill with second port
+  * @param cable set true if port2 was given
   * @return true on success or false on error
   * 
   * Two types of line formats:
   * CA    44  1 0x0002c9030045f121 4x FDR - SW     2 17 0x0002c903006e1430 ( 'localhost HCA-1' - 'MF0;js01ib2:SX60XX/U1' )
   * SW     2 19 0x0002c903006e1430 4x SDR                                    'MF0;js01ib2:SX60XX/U1'
   */
-  bool parse_line(const std::string &line, port_t *& port1, port_t *& port2);
+  bool parse_line(const std::string &line, port_t &port1, port_t &port2, bool &cable);
 };
+
+/**
+ *@brief 'ibnetdiscover --cache' binary file reader
+ * Reads the fabric cache written by libibnetdisc (ibnd_cache_fabric())
+ * and populates a IB port map with the same ports as ibnetdiscover_p_t
+ *
+ * File layout (all integers little endian):
+ *  header: magic, version, node count, port count, from guid, max hops
+ *  nodes:  smalid, smalmc, switchinfo, guid, type, numports, nodeinfo,
+ *          nodedesc, dr path, dist, stored ports (guid + port num)
+ *  ports:  guid, port num, ext port num (version 2), base lid, lmc,
+ *          portinfo, node guid, remote port flag, remote guid, remote port num
+ *
+ * @see libibnetdisc/ibnetdisc_cache.c from OFED
+ */
+class ibnetdiscover_cache_t {
+public:
+  typedef port_t::portmap_guidport_t portmap_t;
+
+  /**
+   * @brief parse input stream
+   * @param portmap port map to fill with port ptrs (portmap will own all instances)
+   * @param is binary input stream to parse
+   * @return true on success
+   * @warning portmap should always be empty when given to this function
+   * @note switch ports use switch port 0 lid just like 'ibnetdiscover -p'
+   */
+  bool parse(portmap_t &portmap, std::istream &is);
+
+  /**
+   * @brief parse input stream and add every cable to fabric
+   * @param fabric fabric to populate (should be empty)
+   * @param is binary input stream to parse
+   * @return true on success
+   * @note ports are allocated in the fabric port arena (released again if parsing fails)
+   */
+  bool parse(fabric_t &fabric, std::istream &is);
   
+private:
+  /**
+   * @brief parse input stream into port map
+   * @param portmap port map to fill with port ptrs
+   * @param is binary input stream to parse
+   * @param arena arena to allocate ports in (portmap owns ports allocated with new if NULL)
+   * @return true on success
+   */
+  bool parse_ports(portmap_t &portmap, std::istream &is, port_arena_t * const arena);
+};
+
 /**
  *@brief ibdiagnet forwarding database output parser
  * Parse output of ibdiagnet2.fdbs (dumps unicast forwarding database)'
@@ -121,7 +187,160 @@ private:
 //  */
 //  bool parse_line(const std::string &line, port_t *& port1, port_t *& port2);
 };
- 
+
+/**
+ *@brief ibdiagnet multicast forwarding database output parser
+ * Parse output of ibdiagnet2.mcfdbs (dumps multicast forwarding database)
+ * and then populates the MFT of every switch in a infiniband fabric
+ */
+class ibdiagnet_mcast_fwd_db {
+public: 
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   */
+  bool parse(fabric_t &fabric, std::istream &is); 
+};
+
+/**
+ *@brief ibdiagnet adaptive routing table output parser
+ * Parse output of ibdiagnet2.ar (AR group table and AR LFT)
+ * and then populates the adaptive routing table of every switch
+ */
+class ibdiagnet_ar {
+public: 
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   */
+  bool parse(fabric_t &fabric, std::istream &is); 
+};
+
+/**
+ *@brief ibdiagnet SL to VL mapping table output parser
+ * Parse output of ibdiagnet2.sl2vl (one table per port pair)
+ * and then populates the SL to VL tables of every entity in a infiniband fabric
+ */
+class ibdiagnet_sl2vl {
+public: 
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   */
+  bool parse(fabric_t &fabric, std::istream &is); 
+};
+
+/**
+ *@brief ibdiagnet partition key table output parser
+ * Parse output of ibdiagnet2.pkey (pkey table of every port)
+ * and then populates the partitions of a infiniband fabric
+ * 
+ * Switch management ports (port 0) and ports not in the fabric
+ * are skipped.
+ */
+class ibdiagnet_pkey {
+public: 
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   */
+  bool parse(fabric_t &fabric, std::istream &is); 
+};
+
+/**
+ *@brief linear forwarding table dump parser
+ * Parse output of 'ibroute', 'dump_lfts.sh' or opensm-lfts.dump
+ * and then populates a infiniband fabric
+ *
+ * Input is read as a stream of switch blocks and every switch
+ * block is parsed in parallel in batches before the routes
+ * are added to the fabric
+ */
+class dump_lfts_t {
+public:
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   */
+  bool parse(fabric_t &fabric, std::istream &is);
+
+private:
+  /**
+   * @brief single switch LFT block
+   */
+  struct block_t {
+    /**
+     * @brief switch guid from block header
+     */
+    guid_t guid;
+    /**
+     * @brief raw lines of block (header excluded)
+     */
+    std::vector<std::string> lines;
+    /**
+     * @brief parsed routes (lid, port)
+     */
+    std::vector<std::pair<lid_t, port_num_t> > routes;
+    /**
+     * @brief true if any line failed to parse
+     */
+    bool fail;
+  };
+  typedef std::vector<block_t> blocks_t;
+
+  /**
+   * @brief parse lines of a switch block into routes
+   * @param block block to parse
+   * @warning called concurrently, must not touch any shared state
+   */
+  static void parse_block(block_t &block);
+
+  /**
+   * @brief parse all blocks in parallel and add routes to fabric
+   * @param fabric fabric to populate
+   * @param blocks blocks to parse (will be cleared)
+   * @return true on success
+   */
+  bool flush(fabric_t &fabric, blocks_t &blocks);
+};
+
+/**
+ *@brief ibdiagnet link list parser
+ * Parse output of ibdiagnet2.lst (one line per link)
+ * and then gives every port its exact lid and lmc
+ *
+ * ibdiagnet only gives the LMC of a port when it writes a LMC field
+ * otherwise the subnet lmc given to parse() is used for HCA ports 
+ */
+class ibdiagnet_lst {
+public:
+  /**
+   * @brief parse input stream
+   * @param fabric fabric to populate
+   * @param is input stream to parse
+   * @param lmc subnet lmc value used for HCA ports without LMC field
+   * @return true on success
+   * @warning fabric must already be populated with cables
+   * @note call fabric_t::build_lid_map() afterwards to use the port lids
+   */
+  bool parse(fabric_t &fabric, std::istream &is, const lmc_t lmc = 0);
+};
+
   
 
 } }
@@ -36,6 +36,9 @@
 #include<sstream>
 #include<cstdlib>
 #include<cstdio>
+#include<cstring>
+#include<algorithm>
+#include<new>
 
 namespace infiniband {
   
@@ -95,6 +98,185 @@ static re2::RE2 port_type2_regex(
   "\\s*$"
 );
 
+namespace port_speed {
+  
+/**
+ * @brief speed strings in speed_t order
+ */
+static const char * const speed_strings[] = {
+  "??", "SDR", "DDR", "QDR", "FDR10", "FDR", "EDR", "HDR", "NDR", "XDR"
+};
+static const size_t speed_count = sizeof(speed_strings) / sizeof(speed_strings[0]);
+
+/**
+ * @brief unrecognized speed strings (OTHER + id - 1)
+ */
+static string_table_t & other_speeds()
+{
+  static string_table_t table;
+  return table;
+}
+
+speed_t from_string(const std::string &str)
+{
+  for(size_t i = 1; i < speed_count; ++i)
+    if(str == speed_strings[i])
+      return static_cast<speed_t>(i);
+  
+  if(str.empty() || str == speed_strings[UNKNOWN])
+    return UNKNOWN;
+  
+  return static_cast<speed_t>(OTHER + other_speeds().intern(str) - 1);
+}
+
+const char * to_string(const speed_t speed)
+{
+  if(static_cast<size_t>(speed) < speed_count)
+    return speed_strings[speed];
+  
+  if(speed >= OTHER && speed - OTHER + 1 < other_speeds().size())
+    return other_speeds().get(speed - OTHER + 1).c_str();
+  
+  return speed_strings[UNKNOWN];
+}
+
+bool is_known(const speed_t speed)
+{
+  return speed < OTHER;
+}
+
+}
+
+namespace port_width {
+  
+/**
+ * @brief width strings in width_t order
+ */
+static const char * const width_strings[] = {
+  "??", "1x", "2x", "4x", "8x", "12x"
+};
+static const size_t width_count = sizeof(width_strings) / sizeof(width_strings[0]);
+
+/**
+ * @brief unrecognized width strings (OTHER + id - 1)
+ */
+static string_table_t & other_widths()
+{
+  static string_table_t table;
+  return table;
+}
+
+width_t from_string(const std::string &str)
+{
+  for(size_t i = 1; i < width_count; ++i)
+    if(str == width_strings[i])
+      return static_cast<width_t>(i);
+  
+  if(str.empty() || str == width_strings[UNKNOWN])
+    return UNKNOWN;
+  
+  return static_cast<width_t>(OTHER + other_widths().intern(str) - 1);
+}
+
+const char * to_string(const width_t width)
+{
+  if(static_cast<size_t>(width) < width_count)
+    return width_strings[width];
+  
+  if(width >= OTHER && width - OTHER + 1 < other_widths().size())
+    return other_widths().get(width - OTHER + 1).c_str();
+  
+  return width_strings[UNKNOWN];
+}
+
+bool is_known(const width_t width)
+{
+  return width < OTHER;
+}
+
+}
+
+const uint64_t string_table_t::first_block_size = 64;
+
+string_table_t::string_table_t() : count(0)
+{
+  for(size_t i = 0; i < block_count; ++i)
+    blocks[i] = NULL;
+  
+  ///empty string is always id 0
+  blocks[0] = new std::string[first_block_size];
+  ids.insert(std::make_pair(&blocks[0][0], 0));
+  count.store(1, std::memory_order_release);
+}
+
+string_table_t::~string_table_t()
+{
+  for(size_t i = 0; i < block_count; ++i)
+    delete [] blocks[i];
+}
+
+void string_table_t::locate(const string_id_t id, size_t &block, size_t &offset)
+{
+  ///block n starts at id (first_block_size << n) - first_block_size
+  const uint64_t index = static_cast<uint64_t>(id) + first_block_size;
+  
+  block = 0;
+  while((first_block_size << (block + 1)) <= index)
+    ++block;
+  
+  assert(block < block_count);
+  offset = static_cast<size_t>(index - (first_block_size << block));
+}
+
+string_id_t string_table_t::intern(const std::string &str)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  
+  std::map<const std::string *, string_id_t, less_string_ptr_t>::const_iterator itr = ids.find(&str);
+  if(itr != ids.end())
+    return itr->second;
+  
+  const string_id_t id = count.load(std::memory_order_relaxed);
+  assert(id < 0xFFFFFFFF);
+  
+  size_t block, offset;
+  locate(id, block, offset);
+  
+  ///readers never look into a block before its first id is published
+  if(!blocks[block])
+    blocks[block] = new std::string[first_block_size << block];
+  
+  std::string &stored = blocks[block][offset];
+  stored = str;
+  ids.insert(std::make_pair(&stored, id));
+  
+  ///publish string only once stored
+  count.store(id + 1, std::memory_order_release);
+  
+  return id;
+}
+
+const std::string & string_table_t::get(const string_id_t id) const
+{
+  assert(id < count.load(std::memory_order_acquire));
+  
+  ///blocks are never moved or freed so no lock is needed
+  size_t block, offset;
+  locate(id, block, offset);
+  return blocks[block][offset];
+}
+
+size_t string_table_t::size() const
+{
+  return count.load(std::memory_order_acquire);
+}
+
+string_table_t & port_t::get_name_table()
+{
+  static string_table_t table;
+  return table;
+}
+
 const size_t port_t::label_max_size = 1024;
 
 bool port_t::parse(std::string str)
@@ -109,6 +291,7 @@ bool port_t::parse(std::string str)
   assert(port_type2_regex.ok());
   
   regex::map::map_t results;
+  std::string found_name;
   
   ///set type to unknown by default incase parse fails
   type = UNKNOWN;
@@ -118,16 +301,20 @@ bool port_t::parse(std::string str)
 //    for(regex_map::const_iterator itr = results.begin(); itr != results.end(); ++itr)
 //      std::cout << itr->first << " -> " << itr->second << std::endl;
  
-    if(find_defined(results, "hca_host_name", name))
+    if(find_defined(results, "hca_host_name", found_name))
     {
+      set_name(found_name);
+      
       if(!find_defined_int(results, "hca_id", hca))
         return false;
       
       type = HCA;
     }
     
-    if(find_defined(results, "tca_host_name", name))
+    if(find_defined(results, "tca_host_name", found_name))
     {
+      set_name(found_name);
+      
       find_defined_int(results, "spine", spine);
       find_defined_int(results, "hca_id2", hca);
       find_defined_int(results, "leaf", leaf);
@@ -140,7 +327,8 @@ bool port_t::parse(std::string str)
   }  
   else if(regex::match(str, port_type2_regex, results))
   {
-    find_defined(results, "name", name);
+    if(find_defined(results, "name", found_name))
+      set_name(found_name);
     find_defined_int(results, "hca", hca);
     find_defined_int(results, "leaf", leaf);
     find_defined_int(results, "port", port);
@@ -161,7 +349,7 @@ bool port_t::parse(std::string str)
      * @example 'SwitchX -  Mellanox Technologies'
      * this will count as a valid port name for parsing but basically useless
      */
-    name = str;
+    set_name(str);
   }
   else ///empty unknown port
 	return false;
@@ -171,39 +359,53 @@ bool port_t::parse(std::string str)
 
 std::string port_t::label(port_t::label_t ltype) const
 {
-  char buffer[label_max_size];
+  std::string str;
+  append_label(str, ltype);
+  return str;
+}
+
+void port_t::append_label(std::string &str, port_t::label_t ltype) const
+{
+  ///only the suffix is formatted, name is appended as is
+  char suffix[16];
+  const std::string &name = get_name();
   assert(name.size());
   
   switch(ltype)
   {
     case port_t::LABEL_FULL:
       if(spine)
-        std::snprintf(buffer, sizeof(buffer), "%s/S%02u/P%02u", name.c_str(), spine, port);
+        std::snprintf(suffix, sizeof(suffix), "/S%02u/P%02u", spine, port);
       else if(leaf)
-        std::snprintf(buffer, sizeof(buffer), "%s/L%02u/P%02u", name.c_str(), leaf, port);
+        std::snprintf(suffix, sizeof(suffix), "/L%02u/P%02u", leaf, port);
       else if(hca)
-        std::snprintf(buffer, sizeof(buffer), "%s/H%02u/P%02u", name.c_str(), hca, port);
+        std::snprintf(suffix, sizeof(suffix), "/H%02u/P%02u", hca, port);
       else if(port)
-        std::snprintf(buffer, sizeof(buffer), "%s/P%02u", name.c_str(), port);
+        std::snprintf(suffix, sizeof(suffix), "/P%02u", port);
       else
-        std::snprintf(buffer, sizeof(buffer), "%s", name.c_str());
+        suffix[0] = '\0';
       break;
     case port_t::LABEL_ENTITY_ONLY:
       if(spine)
-        std::snprintf(buffer, sizeof(buffer), "%s/S%02u", name.c_str(), spine);
+        std::snprintf(suffix, sizeof(suffix), "/S%02u", spine);
       else if(leaf)
-        std::snprintf(buffer, sizeof(buffer), "%s/L%02u", name.c_str(), leaf);
+        std::snprintf(suffix, sizeof(suffix), "/L%02u", leaf);
       else if(hca)
-        std::snprintf(buffer, sizeof(buffer), "%s/H%02u", name.c_str(), hca);
+        std::snprintf(suffix, sizeof(suffix), "/H%02u", hca);
       else
-        std::snprintf(buffer, sizeof(buffer), "%s", name.c_str());
+        suffix[0] = '\0';
       break; 
     default:
       ///Nothing to see here...not sure how you got here either
       assert(false);
+      suffix[0] = '\0';
   }
   
-  return std::string(buffer);
+  ///labels are truncated to label_max_size - 1 characters
+  const size_t max = label_max_size - 1;
+  const size_t name_size = std::min(name.size(), max);
+  str.append(name, 0, name_size);
+  str.append(suffix, std::min(std::strlen(suffix), max - name_size));
 }
 
 port_t::key_guid_port_t::key_guid_port_t(const port_t& _port)
@@ -241,5 +443,154 @@ bool port_t::key_guid_port_t::operator<(const port_t::key_guid_port_t& other) co
     return guid < other.guid;
 }
 
+const size_t port_arena_t::slab_ports = 1024;
+
+port_arena_t::port_arena_t()
+  : current(NULL), used(0), adopted_sorted(0)
+{
+}
+
+port_arena_t::port_arena_t(port_arena_t &&other)
+  : slabs(std::move(other.slabs)), sorted_slabs(std::move(other.sorted_slabs)), 
+    current(other.current), used(other.used), 
+    adopted(std::move(other.adopted)), adopted_sorted(other.adopted_sorted)
+{
+  other.slabs.clear();
+  other.sorted_slabs.clear();
+  other.adopted.clear();
+  other.current = NULL;
+  other.used = 0;
+  other.adopted_sorted = 0;
+}
+
+port_arena_t &port_arena_t::operator=(port_arena_t &&other)
+{
+  if(this == &other)
+    return *this;
+  
+  clear();
+  
+  slabs.swap(other.slabs);
+  sorted_slabs.swap(other.sorted_slabs);
+  adopted.swap(other.adopted);
+  current = other.current;
+  used = other.used;
+  adopted_sorted = other.adopted_sorted;
+  other.current = NULL;
+  other.used = 0;
+  other.adopted_sorted = 0;
+  
+  return *this;
+}
+
+port_arena_t::~port_arena_t()
+{
+  clear();
+}
+
+port_t * port_arena_t::create(const port_t &port)
+{
+  if(!current || used == slab_ports)
+  {
+    current = static_cast<port_t *>(::operator new(slab_ports * sizeof(port_t)));
+    slabs.push_back(current);
+    sorted_slabs.insert(std::upper_bound(sorted_slabs.begin(), sorted_slabs.end(), current), current);
+    used = 0;
+  }
+  
+  port_t * const ptr = new(current + used) port_t(port);
+  ++used;
+  return ptr;
+}
+
+void port_arena_t::adopt(port_t * const port)
+{
+  assert(port);
+  assert(!created(port));
+  
+  adopted.push_back(port);
+}
+
+bool port_arena_t::created(const port_t * const port) const
+{
+  ///Last slab starting at or before port
+  std::vector<port_t *>::const_iterator itr = std::upper_bound(sorted_slabs.begin(), sorted_slabs.end(), port);
+  if(itr == sorted_slabs.begin())
+    return false;
+  
+  --itr;
+  const size_t count = *itr == current ? used : slab_ports;
+  return port < *itr + count;
+}
+
+bool port_arena_t::owns(const port_t * const port) const
+{
+  if(created(port))
+    return true;
+  
+  ///ports adopted since the last search are sorted in
+  if(adopted_sorted != adopted.size())
+  {
+    std::sort(adopted.begin() + adopted_sorted, adopted.end());
+    std::inplace_merge(adopted.begin(), adopted.begin() + adopted_sorted, adopted.end());
+    adopted_sorted = adopted.size();
+  }
+  
+  return std::binary_search(adopted.begin(), adopted.end(), const_cast<port_t *>(port));
+}
+
+size_t port_arena_t::size() const
+{
+  return get_mark() + adopted.size();
+}
+
+size_t port_arena_t::get_mark() const
+{
+  return slabs.empty() ? 0 : (slabs.size() - 1) * slab_ports + used;
+}
+
+void port_arena_t::release(const size_t mark)
+{
+  const size_t count = get_mark();
+  assert(mark <= count);
+  
+  for(size_t i = mark; i < count; ++i)
+    slabs[i / slab_ports][i % slab_ports].~port_t();
+  
+  ///only keep slabs still holding ports
+  const size_t keep = (mark + slab_ports - 1) / slab_ports;
+  while(slabs.size() > keep)
+  {
+    sorted_slabs.erase(std::lower_bound(sorted_slabs.begin(), sorted_slabs.end(), slabs.back()));
+    ::operator delete(slabs.back());
+    slabs.pop_back();
+  }
+  
+  current = slabs.empty() ? NULL : slabs.back();
+  used = slabs.empty() ? 0 : mark - (slabs.size() - 1) * slab_ports;
+}
+
+void port_arena_t::clear()
+{
+  for(size_t i = 0; i < slabs.size(); ++i)
+  {
+    const size_t count = slabs[i] == current ? used : slab_ports;
+    for(size_t j = 0; j < count; ++j)
+      slabs[i][j].~port_t();
+    
+    ::operator delete(slabs[i]);
+  }
+  
+  for(std::vector<port_t *>::iterator itr = adopted.begin(); itr != adopted.end(); ++itr)
+    delete *itr;
+  
+  slabs.clear();
+  sorted_slabs.clear();
+  adopted.clear();
+  adopted_sorted = 0;
+  current = NULL;
+  used = 0;
+}
+
 }
 
@@ -39,6 +39,10 @@
 #include<cstdint>
 #endif ///cplusplus
 #include<map>
+#include<set>
+#include<mutex>
+#include<atomic>
+#include<utility>
 
 #ifndef IB_PORT_H
 #define IB_PORT_H
@@ -68,6 +72,11 @@ typedef uint8_t port_num_t;
  * @see https://tools.ietf.org/html/rfc4392
  */
 typedef uint64_t lid_t;
+/**
+ * @brief LID Max Value
+ * extended LIDs are at most 32 bits
+ */
+const lid_t MAX_LID_VALUE = 0xFFFFFFFF;
 /**
  * @brief LID Mask Control (lmc)
  * LIDs = BASELID to BASELID* + 2^LMC − 1
@@ -78,6 +87,40 @@ typedef uint8_t lmc_t;
  * LMC is given as 3 bits = 2^7 = 128 possible lids
  */
 const lmc_t MAX_LMC_VALUE = 7;
+/**
+ * @brief Private Linear Forwarding Table number (plft)
+ * switches may hold multiple LFTs selected by ingress port and SL
+ * PLFT 0 is the only LFT of switches without PLFT support
+ */
+typedef uint8_t plft_num_t;
+/**
+ * @brief Service Level (sl)
+ * 4 bits given in every packet LRH
+ */
+typedef uint8_t sl_t;
+/**
+ * @brief Virtual Lane (vl)
+ * 4 bits, VL15 is reserved for subnet management
+ */
+typedef uint8_t vl_t;
+/**
+ * @brief Number of Service Levels
+ */
+const sl_t SL_COUNT = 16;
+/**
+ * @brief Partition Key (pkey)
+ * high bit gives full (1) or limited (0) membership
+ * low 15 bits give the partition
+ */
+typedef uint16_t pkey_t;
+/**
+ * @brief pkey full membership bit
+ */
+const pkey_t PKEY_FULL_MEMBER = 0x8000;
+/**
+ * @brief pkey partition bits
+ */
+const pkey_t PKEY_BASE_MASK = 0x7FFF;
 
 namespace port_type {
   /**
@@ -90,6 +133,190 @@ namespace port_type {
   };
 }
 
+namespace port_speed {
+  /**
+   * @brief port link speed
+   */
+  enum speed_t : uint32_t {
+    UNKNOWN, ///speed unknown (??)
+    SDR,
+    DDR,
+    QDR,
+    FDR10,
+    FDR,
+    EDR,
+    HDR,
+    NDR,
+    XDR,
+    OTHER ///first speed given by an unrecognized string
+  };
+  
+  /**
+   * @brief convert speed string to speed
+   * @param str speed string (ie "FDR")
+   * @return speed, UNKNOWN for "??" (or empty string) or OTHER and up 
+   *  for a string that is not a known speed
+   * @note unrecognized strings are kept so to_string() gives them back
+   */
+  speed_t from_string(const std::string &str);
+  
+  /**
+   * @brief convert speed to speed string
+   * @param speed speed to convert
+   * @return speed string as given by ibnetdiscover ("??" if unknown)
+   */
+  const char * to_string(const speed_t speed);
+  
+  /**
+   * @brief check if speed is one of the known speeds (or UNKNOWN)
+   * @param speed speed to check
+   * @return false if speed was given by an unrecognized string
+   */
+  bool is_known(const speed_t speed);
+}
+
+namespace port_width {
+  /**
+   * @brief port link width
+   */
+  enum width_t : uint32_t {
+    UNKNOWN, ///width unknown (??)
+    X1,
+    X2,
+    X4,
+    X8,
+    X12,
+    OTHER ///first width given by an unrecognized string
+  };
+  
+  /**
+   * @brief convert width string to width
+   * @param str width string (ie "4x")
+   * @return width, UNKNOWN for "??" (or empty string) or OTHER and up 
+   *  for a string that is not a known width
+   * @note unrecognized strings are kept so to_string() gives them back
+   */
+  width_t from_string(const std::string &str);
+  
+  /**
+   * @brief convert width to width string
+   * @param width width to convert
+   * @return width string as given by ibnetdiscover ("??" if unknown)
+   */
+  const char * to_string(const width_t width);
+  
+  /**
+   * @brief check if width is one of the known widths (or UNKNOWN)
+   * @param width width to check
+   * @return false if width was given by an unrecognized string
+   */
+  bool is_known(const width_t width);
+}
+
+/**
+ * @brief interned string id
+ * id 0 is always the empty string
+ */
+typedef uint32_t string_id_t;
+
+/**
+ * @brief interned string table
+ * Every unique string is stored once and referenced by id.
+ * Strings are never removed and ids are stable for the life of the table.
+ * 
+ * Strings are stored in blocks that double in size and never move,
+ * so get() and size() take no lock and only intern() is serialized.
+ * 
+ * @note intern() and get() may be called concurrently
+ * @warning memory grows with every distinct string and is only 
+ *  released with the table
+ */
+class string_table_t {
+public:
+  /**
+   * @brief ctor
+   * table starts with only the empty string (id 0)
+   */
+  string_table_t();
+  
+  /**
+   * @brief dtor
+   */
+  ~string_table_t();
+  
+  /**
+   * @brief intern string
+   * @param str string to intern
+   * @return id of string (same id for every equal string)
+   */
+  string_id_t intern(const std::string &str);
+  
+  /**
+   * @brief get interned string
+   * @param id id returned by intern()
+   * @return interned string
+   */
+  const std::string & get(const string_id_t id) const;
+  
+  /**
+   * @brief get number of interned strings (including empty string)
+   */
+  size_t size() const;
+  
+private:
+  /**
+   * @brief table can not be copied
+   */
+  string_table_t(const string_table_t &);
+  string_table_t &operator=(const string_table_t &);
+  
+  /**
+   * @brief order strings by value (ids are keyed by the stored strings)
+   */
+  struct less_string_ptr_t {
+    bool operator()(const std::string * const a, const std::string * const b) const { return *a < *b; }
+  };
+  
+  /**
+   * @brief strings in first block (power of 2)
+   */
+  static const uint64_t first_block_size;
+  
+  /**
+   * @brief enough blocks for every string_id_t
+   */
+  static const size_t block_count = 27;
+  
+  /**
+   * @brief find where string of id is stored
+   * @param id id of string
+   * @param block block holding string
+   * @param offset offset of string in block
+   */
+  static void locate(const string_id_t id, size_t &block, size_t &offset);
+  
+  /**
+   * @brief every string in id order 
+   * block n holds first_block_size << n strings
+   */
+  std::string * blocks[block_count];
+  
+  /**
+   * @brief number of strings (published after the string is stored)
+   */
+  std::atomic<uint32_t> count;
+  
+  /**
+   * @brief id of every string
+   */
+  std::map<const std::string *, string_id_t, less_string_ptr_t> ids;
+  
+  /**
+   * @brief serializes intern()
+   */
+  std::mutex lock;
+};
+
 /**
  * @brief Infiniband Port
  * Holds the properties of a given infinband port
@@ -164,6 +391,12 @@ public:
   */
   lid_t lid;
   /**
+  * @brief port LMC
+  * port owns lids from base lid to base lid + 2^lmc - 1
+  * @warning only known when given by source (ibdiagnet2.lst)
+  */
+  lmc_t lmc;
+  /**
   * @brief port number
   */
   port_num_t port;
@@ -173,20 +406,20 @@ public:
   guid_t guid;
   /**
   * @brief port width
-  * @todo decide if this is worthless
+  * @see port_width::to_string() for string
   */
-  std::string width;
+  port_width::width_t width;
   /**
   * @brief port speed
-  * @todo decide if this is worthless
-  * @note SDR, QDR, FDR10, FDR
+  * @see port_speed::to_string() for string
   */
-  std::string speed;
+  port_speed::speed_t speed;
   /**
-  * @brief port switch/host name 
+  * @brief port switch/host name id
   * each chip gets assigned a name that may or may not be unique
+  * @see get_name_table()
   */
-  std::string name;
+  string_id_t name;
   /**
   * @brief port switch leaf id
   */
@@ -221,6 +454,32 @@ public:
   */
   std::string label(label_t ltype = LABEL_FULL) const;
   
+  /**
+  * @brief append port label to string
+  * @param str string to append label to
+  * @param ltype type of label to generate
+  * @note only allocates when str has to grow (reuse str to avoid allocations)
+  */
+  void append_label(std::string &str, label_t ltype = LABEL_FULL) const;
+  
+  /**
+   * @brief get port switch/host name
+   */
+  const std::string & get_name() const { return get_name_table().get(name); }
+  
+  /**
+   * @brief set port switch/host name
+   * @param str name to intern
+   */
+  void set_name(const std::string &str) { name = get_name_table().intern(str); }
+  
+  /**
+   * @brief get table holding every port name
+   * Shared by every port so ports parsed without a fabric
+   * and ports moved between fabrics keep the same name ids
+   */
+  static string_table_t & get_name_table();
+  
 private:
   /**
    * @brief Max Label size
@@ -239,6 +498,231 @@ public:
   port_t * connection;
 };
 
+/**
+ * @brief open addressing hash index keyed by guid and port number
+ * Maps (guid, port) to a pointer with linear probing over a single
+ * contiguous slot array. Capacity is always a power of 2 and the
+ * array is never more than half full.
+ * 
+ * Use port 0 to index by guid only. Values can only be replaced
+ * or cleared and are never owned by the index.
+ */
+template<typename T>
+class guid_port_hash_t {
+public:
+  /**
+   * @brief ctor
+   */
+  guid_port_hash_t() : count(0) {}
+  
+  /**
+   * @brief copy ctor
+   */
+  guid_port_hash_t(const guid_port_hash_t &other) : slots(other.slots), count(other.count) {}
+  
+  /**
+   * @brief move ctor
+   * @param other index to move (left empty)
+   */
+  guid_port_hash_t(guid_port_hash_t &&other) : slots(std::move(other.slots)), count(other.count) { other.clear(); }
+  
+  guid_port_hash_t &operator=(const guid_port_hash_t &other) { slots = other.slots; count = other.count; return *this; }
+  guid_port_hash_t &operator=(guid_port_hash_t &&other) { slots.swap(other.slots); count = other.count; other.clear(); return *this; }
+  
+  /**
+   * @brief make room for keys without growing
+   * @param size number of keys
+   */
+  void reserve(const size_t size);
+  
+  /**
+   * @brief insert or replace value of key
+   * @param guid key guid
+   * @param port key port number
+   * @param value value ptr (may not be NULL)
+   */
+  void insert(const guid_t guid, const port_num_t port, T * const value);
+  
+  /**
+   * @brief find value of key
+   * @param guid key guid
+   * @param port key port number
+   * @return value ptr or NULL if key is not known
+   */
+  T * find(const guid_t guid, const port_num_t port = 0) const;
+  
+  /**
+   * @brief get number of keys
+   */
+  size_t size() const { return count; }
+  
+  /**
+   * @brief clear every key
+   */
+  void clear() { slots.clear(); count = 0; }
+  
+private:
+  /**
+   * @brief hash slot (empty if value is NULL)
+   */
+  struct slot_t {
+    guid_t guid;
+    T *value;
+    port_num_t port;
+  };
+  
+  /**
+   * @brief mix guid and port into slot hash
+   */
+  static size_t hash(const guid_t guid, const port_num_t port);
+  
+  /**
+   * @brief find slot of key or empty slot where key belongs
+   */
+  size_t probe(const guid_t guid, const port_num_t port) const;
+  
+  /**
+   * @brief every slot
+   */
+  std::vector<slot_t> slots;
+  
+  /**
+   * @brief number of used slots
+   */
+  size_t count;
+};
+
+/**
+ * @brief slab allocator for ports
+ * Ports are constructed in fixed size slabs and are only 
+ * destroyed when the arena is cleared (one free per slab)
+ * or released back to a mark (newest ports first)
+ * 
+ * Ports allocated elsewhere (with new) can be adopted so the
+ * arena always owns every port given to it
+ */
+class port_arena_t {
+public:
+  /**
+   * @brief ports per slab
+   */
+  static const size_t slab_ports;
+  
+  /**
+   * @brief ctor
+   */
+  port_arena_t();
+  
+  /**
+   * @brief move ctor
+   * @param other arena to move (left empty)
+   * @note ports are not moved so port ptrs stay valid
+   */
+  port_arena_t(port_arena_t &&other);
+  
+  /**
+   * @brief move assignment
+   * @param other arena to move (left empty)
+   * @warning destroys every port owned before the move
+   */
+  port_arena_t &operator=(port_arena_t &&other);
+  
+  /**
+   * @brief dtor
+   * destroys every port
+   */
+  ~port_arena_t();
+  
+  /**
+   * @brief construct new port in arena
+   * @param port port to copy
+   * @return ptr to port (owned by arena)
+   */
+  port_t * create(const port_t &port);
+  
+  /**
+   * @brief take ownership of port allocated with new
+   * @param port port to adopt (must not be owned yet)
+   */
+  void adopt(port_t * const port);
+  
+  /**
+   * @brief check if port is owned by arena
+   * @param port port to check
+   * @return true if port was created or adopted by arena
+   */
+  bool owns(const port_t * const port) const;
+  
+  /**
+   * @brief check if port was constructed by create()
+   * @param port port to check
+   * @return true if port is in a slab
+   */
+  bool created(const port_t * const port) const;
+  
+  /**
+   * @brief get number of ports owned
+   */
+  size_t size() const;
+  
+  /**
+   * @brief get mark to release newer ports with release()
+   * @return number of ports created so far
+   */
+  size_t get_mark() const;
+  
+  /**
+   * @brief destroy every port created after mark
+   * @param mark mark from get_mark()
+   * @warning ports created after mark must not be referenced anymore
+   * @note adopted ports are not released
+   */
+  void release(const size_t mark);
+  
+  /**
+   * @brief destroy every port
+   */
+  void clear();
+  
+private:
+  /**
+   * @brief arena can not be copied
+   */
+  port_arena_t(const port_arena_t &);
+  port_arena_t &operator=(const port_arena_t &);
+  
+  /**
+   * @brief every slab (in creation order)
+   */
+  std::vector<port_t *> slabs;
+  
+  /**
+   * @brief every slab (sorted by address)
+   */
+  std::vector<port_t *> sorted_slabs;
+  
+  /**
+   * @brief slab new ports are constructed in (last slab)
+   */
+  port_t *current;
+  
+  /**
+   * @brief ports constructed in current slab
+   */
+  size_t used;
+  
+  /**
+   * @brief every adopted port 
+   * only sorted when owns() needs to search it
+   */
+  mutable std::vector<port_t *> adopted;
+  
+  /**
+   * @brief number of adopted ports sorted
+   */
+  mutable size_t adopted_sorted;
+};
+
 ///** 
 // * @brief network entity that contains ports
 // * this is either an HCA or a switch 
@@ -253,4 +737,6 @@ public:
   
 }
 
+#include "ib_port.tpp"
+
 #endif  // IB_PORT_H
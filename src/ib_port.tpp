@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015, University Corporation for Atmospheric Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include<vector>
+#include<cassert>
+
+namespace infiniband {
+
+template<typename T>
+size_t guid_port_hash_t<T>::hash(const guid_t guid, const port_num_t port)
+{
+  ///splitmix64 finalizer
+  uint64_t x = guid ^ (static_cast<uint64_t>(port) << 56 | port);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return static_cast<size_t>(x ^ (x >> 31));
+}
+
+template<typename T>
+size_t guid_port_hash_t<T>::probe(const guid_t guid, const port_num_t port) const
+{
+  assert(!slots.empty());
+  
+  const size_t mask = slots.size() - 1;
+  size_t i = hash(guid, port) & mask;
+  
+  while(slots[i].value && (slots[i].guid != guid || slots[i].port != port))
+    i = (i + 1) & mask;
+  
+  return i;
+}
+
+template<typename T>
+void guid_port_hash_t<T>::reserve(const size_t size)
+{
+  size_t capacity = 16;
+  while(capacity < size * 2)
+    capacity <<= 1;
+  
+  if(capacity <= slots.size())
+    return;
+  
+  ///Rehash every used slot into new slots
+  std::vector<slot_t> old(capacity);
+  old.swap(slots);
+  
+  for(size_t i = 0; i < old.size(); ++i)
+    if(old[i].value)
+      slots[probe(old[i].guid, old[i].port)] = old[i];
+}
+
+template<typename T>
+void guid_port_hash_t<T>::insert(const guid_t guid, const port_num_t port, T * const value)
+{
+  assert(value);
+  
+  if((count + 1) * 2 > slots.size())
+    reserve(count + 1);
+  
+  slot_t &slot = slots[probe(guid, port)];
+  if(!slot.value)
+    ++count;
+  
+  slot.guid = guid;
+  slot.port = port;
+  slot.value = value;
+}
+
+template<typename T>
+T * guid_port_hash_t<T>::find(const guid_t guid, const port_num_t port) const
+{
+  if(slots.empty())
+    return NULL;
+  
+  return slots[probe(guid, port)].value;
+}
+
+}